@@ -4,53 +4,132 @@
 #ifndef CASE_AGENTMANAGER
 #define CASE_AGENTMANAGER
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <utility>
 #include <vector>
 #include <list>
+#include <numeric>
 
+#include "index.hpp"
+#include "neighbors.hpp"
 #include "pair.hpp"
 #include "random.hpp"
 #include "job.hpp"
+#include "profile.hpp"
+#include "memory.hpp"
 
 namespace CASE {
 
-template <class Agent>
+template <class Agent, class Index = int>
 class AgentManager {
-    Agent * agents = nullptr;
-    const int max_agents;
-    std::vector<int> inactive;
-    
+    static_assert(std::is_signed<Index>::value,
+                  "AgentManager Index must be signed.");
+
     class ShuffleJob : public Job {
         Uniform<> random;
-        std::vector<int> * indices;
+        std::vector<Index> * indices;
 
         void execute() override {
             assert(indices != nullptr);
+            PhaseScope scope{Phase::Shuffle};
             random.shuffle(*indices);
         }
 
+        const char * name() const override { return "shuffle"; }
+
     public:
-        void upload(std::vector<int> * i) { indices = i; }
+        void upload(std::vector<Index> * i) { indices = i; }
 
     } shuffle ;
 
-    Pair<std::vector<int>> indices;
-    
+    Pair<std::vector<Index>> indices;
+
+protected:
+    Agent * agents = nullptr;
+    const Index max_agents;
+    std::vector<Index> inactive;
+
 public:
-    AgentManager(const int max) : max_agents(max)
-    {
-        clear();
-        shuffle.thread = std::thread{[this]{ shuffle.run(); }};
+    // how far apart in the grid agents in consecutive slots are, on
+    // average, before and after each sort(), summed over the sorts
+    struct Locality {
+        long sorts = 0;
+        double before = 0, after = 0;
+    };
+
+private:
+    Locality locality;
+
+    // the mean number of cells, in x plus y, between the cells of live
+    // agents in consecutive slots
+    double spread() const {
+        const Agent * last = nullptr;
+        double sum = 0;
+        Index steps = 0;
+        for (Index i = 0; i < max_agents; i++) {
+            const auto & agent = agents[i];
+            if (agent.active() == false || agent.cell == nullptr)
+                continue;
+            if (last != nullptr) {
+                sum += std::abs(agent.cell->x - last->cell->x)
+                     + std::abs(agent.cell->y - last->cell->y);
+                steps++;
+            }
+            last = &agent;
+        }
+        return steps == 0 ? 0.0 : sum / steps;
     }
 
-    void update() {
+protected:
+
+    // the order of this update, shuffled by the time it is needed
+    const std::vector<Index> & order() {
 #ifndef CASE_DETERMINISTIC
         indices.flip();
-        shuffle.wait();
+        {
+            PhaseScope scope{Phase::Barrier};
+            shuffle.wait();
+        }
         shuffle.upload(&indices.next());
         shuffle.launch();
 #endif
-        for (const auto i : indices.current()) {
+        return indices.current();
+    }
+
+    // lists the slots of agents that have died since the last time,
+    // taking them out of their cells
+    void reclaim() {
+        for (Index i = 0; i < max_agents; i++) {
+            auto & agent = agents[i];
+            if (agent.active() == false) {
+                inactive.push_back(i);
+                if (agent.cell != nullptr)
+                    agent.cell->extract(agent.z);
+            }
+        }
+    }
+
+public:
+    // how the cells of these agents find their neighbours, if they are not
+    // one flat array, see ChunkedGrid
+    Locator locator;
+
+    // the current arrays of the fields of the grid of these cells, set by
+    // Grid::init(), see ZCell::field()
+    float * const * field_arrays = nullptr;
+
+    AgentManager(const Index max) : max_agents(max)
+    {
+        clear();
+        shuffle.thread = std::thread{[this]{ shuffle.run(); }};
+    }
+
+    void update() {
+        for (const auto i : order()) {
             if (agents[i].active())
                 agents[i].update();
         }
@@ -58,22 +137,13 @@ public:
 
     ~AgentManager() {
         shuffle.terminate();
-        if (agents != nullptr)
-            delete [] agents;
+        deallocate(agents, max_agents);
         agents = nullptr;
     }
 
     Agent * spawn(Agent && agent) {
-        if (inactive.empty()) {
-            for (auto i = 0; i < max_agents; i++) {
-                auto & agent = agents[i];
-                if (agent.active() == false) {
-                    inactive.push_back(i);
-                    if (agent.cell != nullptr)
-                        agent.cell->extract(agent.z);
-                }
-            }
-        }
+        if (inactive.empty())
+            reclaim();
         if (inactive.empty())
             return nullptr;
 
@@ -85,14 +155,73 @@ public:
         return &agents[i];
     }
 
-    int popcount() const {
-        return max_agents - inactive.size();
+    // Packs the live agents into the lowest slots in the Z-order of their
+    // cells, so that the update walks agents and cells roughly together,
+    // and points their cells at the new slots. Anything else holding the
+    // address of an agent is left pointing at another one.
+    void sort() {
+        // dead agents still in cells would be left pointing at live ones
+        for (Index i = 0; i < max_agents; i++) {
+            auto & agent = agents[i];
+            if (agent.active() == false && agent.cell != nullptr)
+                agent.cell->extract(agent.z);
+        }
+
+        // flipping the sign bit keeps negative coordinates, as in a
+        // ChunkedGrid, before the positive ones
+        const auto bias = [](const int v) {
+            return static_cast<std::uint32_t>(v) ^ 0x80000000u;
+        };
+        std::vector<std::pair<std::uint64_t, Index>> order;
+        for (Index i = 0; i < max_agents; i++) {
+            const auto & agent = agents[i];
+            if (agent.active() && agent.cell != nullptr) {
+                order.emplace_back(morton(bias(agent.cell->x),
+                                          bias(agent.cell->y)), i);
+            }
+        }
+        std::sort(order.begin(), order.end());
+
+        const auto before = spread();
+        std::vector<Agent> packed;
+        packed.reserve(order.size());
+        for (const auto & entry : order)
+            packed.push_back(agents[entry.second]);
+
+        const auto live = static_cast<Index>(packed.size());
+        for (Index i = 0; i < live; i++) {
+            agents[i] = packed[i];
+            agents[i].cell->relocate(agents[i]);
+        }
+        // the rest are dead, or stale copies of agents that moved down
+        for (Index i = live; i < max_agents; i++) {
+            agents[i].deactivate();
+            agents[i].cell = nullptr;
+        }
+        inactive.resize(max_agents - live);
+        std::iota(inactive.rbegin(), inactive.rend(), live);
+
+        locality.sorts++;
+        locality.before += before;
+        locality.after += spread();
+    }
+
+    const Locality & sort_locality() const { return locality; }
+
+    Index popcount() const {
+        return max_agents - static_cast<Index>(inactive.size());
     }
 
+    const Agent * data() const { return agents; }
+    Index capacity() const { return max_agents; }
+
     void clear() {
-        if (agents != nullptr)
-            delete [] agents;
-        agents = new Agent[max_agents];
+        if (agents == nullptr)
+            agents = allocate<Agent>(max_agents, "agents");
+        else {
+            for (Index i = 0; i < max_agents; i++)
+                agents[i] = Agent{};
+        }
 
         auto & a = indices.current();
         a.resize(max_agents);
@@ -0,0 +1,239 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_AGENT_POOL
+#define CASE_AGENT_POOL
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "agent_manager.hpp"
+#include "neighbors.hpp"
+#include "job.hpp"
+#include "numa.hpp"
+#include "profile.hpp"
+
+namespace CASE {
+
+namespace _impl {
+// the worker of an AgentPool this thread is, -1 outside of its update
+inline int & pool_worker() {
+    static thread_local int worker = -1;
+    return worker;
+}
+} // _impl
+
+// An AgentManager that updates agents on several threads, for agents in
+// AtomicZCells. Each update, workers take disjoint parts of the shuffled
+// agents. Before an agent updates, its worker claims the 3 x 3 cells
+// around it. If another worker holds any of them, the agent is deferred
+// and updated serially once the workers are done. Agents must only touch
+// those nine cells and the agents in them, and draw random numbers from
+// thread_local generators. Agents spawned by a worker come from its own
+// cache of free slots.
+template <class Agent, class Index = int>
+class AgentPool : public AgentManager<Agent, Index> {
+    using Base = AgentManager<Agent, Index>;
+    using Cell = typename std::remove_pointer<decltype(Agent::cell)>::type;
+
+    enum class Pass { Locate, Update };
+
+    class PoolJob : public Job {
+        AgentPool * pool = nullptr;
+        Pass pass = Pass::Locate;
+
+        void execute() override {
+            PhaseScope scope{Phase::Update};
+            _impl::pool_worker() = nth;
+            pool->run(pass, nth, n_threads);
+            _impl::pool_worker() = -1;
+        }
+
+        const char * name() const override { return "pool"; }
+
+    public:
+        using Job::Job;
+
+        void upload(AgentPool & p, const Pass what) {
+            wait();
+            pool = &p;
+            pass = what;
+        }
+    };
+
+    static constexpr std::size_t batch = 64;    // slots moved to a cache at a time
+
+    const std::vector<Index> * shuffled = nullptr;
+    std::vector<Cell *> home;                   // of each agent, when the update began
+    std::vector<std::vector<Index>> caches;     // of free slots, by worker
+    std::vector<std::vector<Index>> deferred;   // by worker
+    std::mutex refill;
+    long long conflicts = 0;
+    std::list<PoolJob> jobs;
+
+    using Around = std::array<Cell *, 9>;
+
+    // the cells around one, found by offsets away from the edges
+    static Around around(Cell * cell) {
+        const auto columns = Neighbors<Cell>::columns;
+        const auto rows = Neighbors<Cell>::rows;
+        if (cell->x == 0 || cell->y == 0 || cell->x >= columns - 1
+            || cell->y >= rows - 1)
+            return Neighbors<Cell>{cell}.cells();
+        Around cells;
+        auto k = 0;
+        for (auto y = -1; y <= 1; y++) {
+            for (auto x = -1; x <= 1; x++)
+                cells[k++] = cell + std::ptrdiff_t(y) * columns + x;
+        }
+        return cells;
+    }
+
+    static bool claim(const Around & cells) {
+        for (std::size_t i = 0; i < cells.size(); i++) {
+            if (cells[i]->try_claim() == false) {
+                while (i-- > 0)
+                    cells[i]->release();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static void release(const Around & cells) {
+        for (auto cell : cells)
+            cell->release();
+    }
+
+    void run(const Pass pass, const int nth, const int n) {
+        const auto & order = *shuffled;
+        const auto size = static_cast<long long>(order.size());
+        const auto first = static_cast<std::size_t>(size * nth / n);
+        const auto last = static_cast<std::size_t>(size * (nth + 1) / n);
+        auto agents = this->agents;
+
+        // where the agents are is read before any of them move
+        if (pass == Pass::Locate) {
+            for (auto k = first; k < last; k++) {
+                const auto i = order[k];
+                home[i] = agents[i].active() ? agents[i].cell : nullptr;
+            }
+            return;
+        }
+        for (auto k = first; k < last; k++) {
+            const auto i = order[k];
+            const auto cell = home[i];
+            if (cell == nullptr)
+                continue;
+            const auto cells = around(cell);
+            if (claim(cells) == false) {
+                deferred[nth].push_back(i);
+                continue;
+            }
+            if (agents[i].active())
+                agents[i].update();
+            release(cells);
+        }
+    }
+
+    void launch(const Pass pass) {
+        for (auto & job : jobs) {
+            job.upload(*this, pass);
+            job.launch();
+        }
+        PhaseScope scope{Phase::Barrier};
+        for (auto & job : jobs)
+            job.wait();
+    }
+
+public:
+    AgentPool(const Index max) : Base(max), home(max, nullptr)
+    {
+        const int threads = worker_count();
+        const auto cpus = affinity_layout();
+        caches.resize(threads);
+        deferred.resize(threads);
+        for (auto i = 0; i < threads; i++) {
+            jobs.emplace_back(i, threads);
+            auto & job = jobs.back();
+            job.thread = std::thread{[&job]{ job.run(); }};
+            if (cpus.empty() == false)
+                pin_thread(job.thread, cpus[i % cpus.size()]);
+        }
+    }
+
+    ~AgentPool() {
+        for (auto & job : jobs)
+            job.terminate();
+    }
+
+    void update() {
+        if (this->inactive.empty())
+            this->reclaim();
+        shuffled = &this->order();
+        // a single worker has nobody to conflict with
+        if (jobs.size() == 1) {
+            for (const auto i : *shuffled) {
+                if (this->agents[i].active())
+                    this->agents[i].update();
+            }
+            return;
+        }
+        launch(Pass::Locate);
+        launch(Pass::Update);
+
+        // the unused cached slots go back first, since spawning serially
+        // may reclaim and would list them twice
+        for (auto & cache : caches) {
+            this->inactive.insert(this->inactive.end(), cache.begin(), cache.end());
+            cache.clear();
+        }
+        for (auto & agents : deferred) {
+            conflicts += static_cast<long long>(agents.size());
+            for (const auto i : agents) {
+                if (this->agents[i].active())
+                    this->agents[i].update();
+            }
+            agents.clear();
+        }
+    }
+
+    // from the cache of the calling worker, or as AgentManager::spawn()
+    // outside of the workers
+    Agent * spawn(Agent && agent) {
+        const auto worker = _impl::pool_worker();
+        if (worker < 0)
+            return Base::spawn(std::forward<Agent>(agent));
+
+        auto & cache = caches[worker];
+        if (cache.empty()) {
+            std::lock_guard<std::mutex> lock{refill};
+            auto & inactive = this->inactive;
+            const auto take = std::min(std::size_t(batch), inactive.size());
+            cache.assign(inactive.end() - take, inactive.end());
+            inactive.resize(inactive.size() - take);
+        }
+        if (cache.empty())
+            return nullptr;
+
+        const auto i = cache.back();
+        cache.pop_back();
+        this->agents[i] = agent;
+        this->agents[i].activate();
+        return &this->agents[i];
+    }
+
+    // the agents deferred to the serial pass so far, by conflicting claims
+    long long conflict_count() const { return conflicts; }
+    int workers() const { return static_cast<int>(jobs.size()); }
+};
+
+} // CASE
+
+#endif // CASE_AGENT_POOL
@@ -0,0 +1,149 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_AREA
+#define CASE_AREA
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "index.hpp"
+
+namespace CASE {
+
+// Sums over rectangles of a world around one cell, four reads each however
+// large. Static agents opt in with
+//   static constexpr int area_radius = 5;     the farthest a rectangle reaches
+//   int area_value() const;                   what the sums add up, >= 0
+//   void update(Agent & next, const Area<Agent> & area) const;
+// in place of update(Agent &), and the engine builds a summed area table of
+// area_value() over the world before each generation.
+template <class T, class = void>
+struct area_radius : std::integral_constant<int, 0> {};
+
+template <class T>
+struct area_radius<T, decltype(void(T::area_radius))>
+    : std::integral_constant<int, T::area_radius> {};
+
+template <class Agent>
+class Area {
+    const std::uint32_t * corner = nullptr;
+    std::size_t stride = 0;
+
+public:
+    static constexpr int radius = area_radius<Agent>::value;
+
+    Area(const std::uint32_t * c, const std::size_t s) : corner(c), stride(s) {}
+
+    // the sum over cells (x, y) with x0 <= x <= x1 and y0 <= y <= y1, as
+    // offsets from the cell
+    long sum(const int x0, const int y0, const int x1, const int y1) const {
+        assert(-radius <= x0 && x0 <= x1 + 1 && x1 <= radius);
+        assert(-radius <= y0 && y0 <= y1 + 1 && y1 <= radius);
+        // differences wrap around along with the table, so the sum is
+        // exact as long as it fits in 32 bits
+        const auto top = corner + std::ptrdiff_t(y0) * std::ptrdiff_t(stride);
+        const auto bottom = corner + std::ptrdiff_t(y1 + 1) * std::ptrdiff_t(stride);
+        return static_cast<std::uint32_t>(bottom[x1 + 1] - top[x1 + 1]
+                                          - bottom[x0] + top[x0]);
+    }
+
+    // the sum over the square of side 2 r + 1 centered on the cell
+    long box(const int r) const {
+        return sum(-r, -r, r, r);
+    }
+};
+
+// true if T has update(T &, const Area<T> &) const
+template <class T, class = void>
+struct has_area : std::false_type {};
+
+template <class T>
+struct has_area<T, decltype(void(std::declval<const T &>().update(
+    std::declval<T &>(), std::declval<const Area<T> &>())))>
+    : std::true_type {};
+
+// The summed area table of a torus padded with radius cells of its other
+// side all around, so that rectangles near the edges need no wrapping.
+// Entry (i, j) is the sum over padded cells [0, i) x [0, j).
+template <class Agent>
+class SummedArea {
+    static constexpr int radius = area_radius<Agent>::value;
+    static_assert(radius >= 0, "area_radius must be >= 0.");
+
+    int columns = 0, rows = 0;
+    std::size_t stride = 0;         // columns + 2 * radius + 1
+    std::vector<std::uint32_t> table;
+
+public:
+    void resize(const int c, const int r) {
+        columns = c;
+        rows = r;
+        stride = std::size_t(c) + 2 * radius + 1;
+        table.assign(stride * (std::size_t(r) + 2 * radius + 1), 0);
+    }
+
+    // the first of the two passes of building the table: running sums
+    // along padded rows [first, last)
+    template <class Index>
+    void sum_rows(const Agent * world, const int first, const int last) {
+        const auto width = columns + 2 * radius;
+        for (auto j = first; j < last; j++) {
+            const auto line = world + index(Index(0), Index(wrap(j - radius, rows)),
+                                            columns);
+            const auto out = &table[(j + 1) * stride + 1];
+            std::uint32_t running = 0;
+            for (auto i = 0; i < width; i++) {
+                const auto x = i - radius;
+                running += line[x >= 0 && x < columns ? x : wrap(x, columns)]
+                               .area_value();
+                out[i] = running;
+            }
+        }
+    }
+
+    // the second, adding up padded columns [first, last) of the row sums
+    void sum_columns(const int first, const int last) {
+        const auto height = rows + 2 * radius;
+        for (auto j = 1; j <= height; j++) {
+            const auto above = &table[(j - 1) * stride + 1];
+            const auto line = &table[j * stride + 1];
+            for (auto i = first; i < last; i++)
+                line[i] += above[i];
+        }
+    }
+
+    int padded_rows() const { return rows + 2 * radius; }
+    int padded_columns() const { return columns + 2 * radius; }
+
+    Area<Agent> around(const int x, const int y) const {
+        return {&table[(y + radius) * stride + x + radius], stride};
+    }
+};
+
+// Updates cells [first, last) of a world of columns cells across from the
+// table of the current generation.
+template <class Agent, class Index>
+void update_area(const Agent * current, Agent * next, Index first,
+                 const Index last, const int columns,
+                 const SummedArea<Agent> & area)
+{
+    while (first < last) {
+        const Index y = first / columns;
+        auto x = static_cast<int>(first % columns);
+        const auto end = std::min(last, index(Index(0), y + 1, columns));
+        for (; first < end; first++, x++) {
+            next[first] = current[first];
+            current[first].update(next[first],
+                                  area.around(x, static_cast<int>(y)));
+        }
+    }
+}
+
+} // CASE
+
+#endif // CASE_AREA
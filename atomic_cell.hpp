@@ -0,0 +1,191 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_ATOMIC_CELL
+#define CASE_ATOMIC_CELL
+
+#include <atomic>
+#include <cassert>
+#include <type_traits>
+#include <vector>
+#include <SFML/Graphics/Vertex.hpp>
+
+#include "neighbors.hpp"
+#include "agent_pool.hpp"
+
+namespace CASE {
+
+// A ZCell whose layer slots are claimed and released by compare-and-swap,
+// for agents updated by several threads at once, see AgentPool. The cell
+// can also be claimed as a whole, which the pool does for the cells around
+// an agent while the agent updates.
+template <class T, int LAYERS, class INDEX = int>
+class AtomicZCell {
+
+    static_assert(LAYERS > 0, "AtomicZCell LAYERS must be > 0.");
+    static_assert(std::is_signed<INDEX>::value,
+                  "AtomicZCell INDEX must be signed.");
+    std::atomic<T *> array[LAYERS];
+    std::atomic<bool> claimed{false};
+    AgentPool<T, INDEX> * manager = nullptr;
+
+public:
+    using Agent = T;
+    using Index = INDEX;
+    using Manager = AgentPool<T, INDEX>;
+    static constexpr int depth = LAYERS;
+    int x = 0, y = 0;
+    Index index = 0;
+
+    AtomicZCell() {
+        for (auto i = 0; i < depth; i++)
+            array[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    AtomicZCell(const AtomicZCell &) = delete;
+    AtomicZCell & operator=(const AtomicZCell &) = delete;
+
+    inline void set_manager(Manager & am) {
+        manager = &am;
+    }
+
+    bool try_claim() {
+        auto expected = false;
+        return claimed.compare_exchange_strong(expected, true,
+                                               std::memory_order_acquire);
+    }
+
+    void release() {
+        claimed.store(false, std::memory_order_release);
+    }
+
+    Agent * spawn(Agent && agent) {
+        assert(manager != nullptr);
+        assert(agent.z >= 0);
+        assert(agent.z < LAYERS);
+
+        const auto here = array[agent.z].load(std::memory_order_acquire);
+        if (here != nullptr && here->active())
+            return nullptr;
+
+        auto pointer = manager->spawn(std::forward<T>(agent));
+        if (pointer == nullptr)
+            return nullptr;
+
+        if (insert(*pointer) == nullptr) {
+            pointer->deactivate();
+            pointer = nullptr;
+        }
+
+        return pointer;
+    }
+
+    auto neighbors() {
+        return Neighbors<AtomicZCell>{this};
+    }
+
+    Agent * getlayer(const int layer) {
+        assert(layer < LAYERS);
+        assert(layer >= 0);
+
+        auto agent = array[layer].load(std::memory_order_acquire);
+        if (agent != nullptr && agent->active() == false) {
+            extract(layer);
+            return array[layer].load(std::memory_order_acquire);
+        }
+        return agent;
+    }
+
+    inline Agent * operator[](const int layer) {
+        return getlayer(layer);
+    }
+
+    // takes the slot if it is empty or holds an inactive agent, and fails
+    // if another thread takes it first
+    Agent * insert(Agent & agent) {
+        const auto layer = agent.z;
+
+        assert(layer >= 0);
+        assert(layer < LAYERS);
+
+        auto expected = array[layer].load(std::memory_order_acquire);
+        if (expected != nullptr && expected->active())
+            return nullptr;
+        if (array[layer].compare_exchange_strong(expected, &agent,
+                std::memory_order_acq_rel) == false)
+            return nullptr;
+        if (expected != nullptr)
+            expected->cell = nullptr;
+
+        if (agent.cell != nullptr)
+            agent.cell->release(layer, agent);
+
+        agent.cell = this;
+        agent.activate();
+        return &agent;
+    }
+
+    Agent * insert(Agent * agent) {
+        if (agent == nullptr)
+            return nullptr;
+        else
+            return insert(*agent);
+    }
+
+    // empties the slot if it still holds agent
+    bool release(const int layer, Agent & agent) {
+        auto expected = &agent;
+        return array[layer].compare_exchange_strong(expected, nullptr,
+                                                    std::memory_order_acq_rel);
+    }
+
+    // points the slot of an agent of this cell at where it has been moved,
+    // only between updates
+    void relocate(Agent & agent) {
+        assert(agent.cell == this);
+        array[agent.z].store(&agent, std::memory_order_relaxed);
+    }
+
+    Agent * extract(const int layer) {
+        assert(layer < LAYERS);
+        assert(layer >= 0);
+
+        auto agent = array[layer].load(std::memory_order_acquire);
+        if (agent != nullptr && release(layer, *agent)) {
+            agent->cell = nullptr;
+            agent->deactivate();
+            return agent;
+        }
+        return nullptr;
+    }
+
+    void draw(std::vector<sf::Vertex> & vertices) const {
+        for (auto i = depth - 1; i >= 0; --i) {
+            const auto agent = array[i].load(std::memory_order_relaxed);
+            if (agent != nullptr && agent->active())
+                agent->draw(x, y, vertices);
+        }
+    }
+
+    void clear() {
+        for (auto i = 0; i < depth; i++)
+            extract(i);
+    }
+
+    int popcount() const {
+        auto count = 0;
+        for (const auto & layer : array) {
+            const auto agent = layer.load(std::memory_order_relaxed);
+            if (agent != nullptr && agent->active())
+                count++;
+        }
+        return count;
+    }
+
+    inline bool is_empty() const { return popcount() == 0; }
+    inline bool is_occupied() const { return !is_empty(); }
+};
+
+} // CASE
+
+#endif // CASE_ATOMIC_CELL
@@ -0,0 +1,197 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_BATCH_SIM
+#define CASE_BATCH_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "index.hpp"
+#include "random.hpp"
+#include "ensemble.hpp"
+#include "stencil.hpp"
+
+namespace CASE {
+
+// The same cell in N worlds. Arithmetic, logic and comparisons work lane
+// by lane, a comparison giving 1 or 0 in each lane, so a rule written for
+// a plain value compiles to a loop over N lanes the compiler vectorizes.
+// Results wrap at the width of T, where a plain value would be promoted
+// to int, so rules should keep their values within T.
+template <class T, int N>
+struct Lanes {
+    T lane[N];
+
+    Lanes() = default;
+
+    Lanes(const T value) {
+        for (auto k = 0; k < N; k++)
+            lane[k] = value;
+    }
+
+#define CASE_LANES_OPERATOR(op)                                              \
+    friend Lanes operator op(const Lanes & a, const Lanes & b) {             \
+        Lanes result;                                                        \
+        for (auto k = 0; k < N; k++)                                         \
+            result.lane[k] = T(a.lane[k] op b.lane[k]);                      \
+        return result;                                                       \
+    }
+    CASE_LANES_OPERATOR(+)
+    CASE_LANES_OPERATOR(-)
+    CASE_LANES_OPERATOR(*)
+    CASE_LANES_OPERATOR(&)
+    CASE_LANES_OPERATOR(|)
+    CASE_LANES_OPERATOR(^)
+    CASE_LANES_OPERATOR(==)
+    CASE_LANES_OPERATOR(!=)
+    CASE_LANES_OPERATOR(<)
+    CASE_LANES_OPERATOR(>)
+    CASE_LANES_OPERATOR(<=)
+    CASE_LANES_OPERATOR(>=)
+    CASE_LANES_OPERATOR(&&)
+    CASE_LANES_OPERATOR(||)
+#undef CASE_LANES_OPERATOR
+
+    friend Lanes operator!(const Lanes & a) {
+        Lanes result;
+        for (auto k = 0; k < N; k++)
+            result.lane[k] = T(!a.lane[k]);
+        return result;
+    }
+};
+
+// b where mask is set, c elsewhere
+template <class Mask, class T>
+T choose(const Mask & mask, const T & b, const T & c) {
+    return mask ? b : c;
+}
+
+template <class T, int N>
+Lanes<T, N> choose(const Lanes<T, N> & mask, const Lanes<T, N> & b,
+                   const Lanes<T, N> & c)
+{
+    Lanes<T, N> result;
+    for (auto k = 0; k < N; k++)
+        result.lane[k] = mask.lane[k] ? b.lane[k] : c.lane[k];
+    return result;
+}
+
+namespace _impl {
+template <class T>
+T & lane(T & value, int) {
+    return value;
+}
+
+template <class T, int N>
+T & lane(Lanes<T, N> & value, const int k) {
+    return value.lane[k];
+}
+
+template <class Config, class Value>
+void batch_step(const Config & config, const Value * current, Value * next,
+                const int columns, const int rows)
+{
+    Stencil<Value> stencil;
+    for (auto y = 0; y < rows; y++) {
+        stencil.row(current, y, columns, rows);
+        const auto line = index(0, y, columns);
+        for (auto x = 0; x < columns; x++) {
+            stencil.column(x, columns);
+            next[line + x] = config.rule(current[line + x], stencil);
+        }
+    }
+}
+} // _impl
+
+// Ensemble() for worlds of plain values, LANES worlds to a thread. The
+// worlds of a batch are interleaved cell by cell, so the step advances the
+// same cell of every world with one operation on Lanes<State, LANES>. The
+// config holds
+//   using State = ...;   an integer type, e.g. std::uint8_t
+//   int columns, rows;
+//   void init(State * cells);
+//   template <class V, class W> V rule(const V & cell, const W & neighbors) const;
+// where rule() is called with V = State when LANES is 1 and with Lanes
+// otherwise, so it must be written with operators and choose() rather
+// than branches on cell values. Then lane k of a batch ends exactly as
+// run k would alone. The rule of the first config in a batch is used for
+// all its lanes: runs should differ in what init() writes, e.g. by their
+// seeds, which are given as in Ensemble(). If the config has
+//   double summary(const State *) const;
+// its value for each final world is kept in the result.
+template <int LANES, class Config>
+std::vector<EnsembleResult> Batched(std::vector<Config> & configs,
+                                    const long generations,
+                                    const std::uint64_t seed = 1)
+{
+    using State = typename Config::State;
+    using Value = typename std::conditional<LANES == 1, State,
+                                            Lanes<State, LANES>>::type;
+    static_assert(std::is_integral<State>::value
+                  && !std::is_same<State, bool>::value,
+                  "State must be an integer other than bool");
+    static_assert(LANES >= 1, "LANES must be positive");
+
+    std::vector<EnsembleResult> results(configs.size());
+    if (configs.empty())
+        return results;
+    _impl::check_sizes(configs);
+    const int columns = configs.front().columns;
+    const int rows = configs.front().rows;
+    const std::size_t size = static_cast<std::size_t>(columns) * rows;
+    const int runs = static_cast<int>(configs.size());
+
+    auto simulate = [&](const int batch) {
+        using namespace std::chrono;
+        const auto first = batch * LANES;
+        const auto count = std::min(LANES, runs - first);
+        std::vector<Value> current(size), next(size);
+        std::vector<State> world(size);
+
+        // lanes past the last run repeat it and are thrown away
+        for (auto k = 0; k < LANES; k++) {
+            const auto run = first + std::min(k, count - 1);
+            _impl::seed_stream().start(seed + run);
+            configs[run].init(world.data());
+            for (std::size_t i = 0; i < size; i++)
+                _impl::lane(current[i], k) = world[i];
+        }
+        _impl::seed_stream().stop();
+
+        const auto start = steady_clock::now();
+        for (auto g = 0; g < generations; g++) {
+            _impl::batch_step(configs[first], current.data(), next.data(),
+                              columns, rows);
+            std::swap(current, next);
+        }
+        const auto seconds = duration<double>(steady_clock::now() - start);
+
+        for (auto k = 0; k < count; k++) {
+            auto & result = results[first + k];
+            result.run = first + k;
+            result.seed = seed + first + k;
+            result.generations = generations;
+            result.seconds = seconds.count() / count;
+            result.units = static_cast<std::uint64_t>(size) * generations;
+            for (std::size_t i = 0; i < size; i++) {
+                world[i] = _impl::lane(current[i], k);
+                result.checksum += state_hash(i, world[i]);
+            }
+            result.summary = _impl::summary(configs[first + k], world.data(),
+                _impl::has_summary<Config, State>{});
+        }
+    };
+
+    _impl::run_pool((runs + LANES - 1) / LANES, simulate);
+    return results;
+}
+
+} // CASE
+
+#endif // CASE_BATCH_SIM
@@ -0,0 +1,213 @@
+/* Author: Mikko Finell
+ * License: Public Domain
+ *
+ * Runs headless demo builds at several thread counts, collects the JSON
+ * line each run prints, adds scaling efficiency, writes the results and
+ * compares throughput against a stored baseline.
+ *
+ * usage: bench [-g generations] [-t 1,2,4] [-o results.json]
+ *              [-b baseline.json] [-r tolerance] binary...
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+struct Result {
+    std::string json;
+    std::string rule, engine;
+    long columns = 0, rows = 0, threads = 0;
+    double per_second = 0.0;
+    double efficiency = 1.0;
+
+    std::tuple<std::string, long, long, long> key() const {
+        return std::make_tuple(rule, columns, rows, threads);
+    }
+};
+
+std::string field(const std::string & json, const std::string & name) {
+    const auto key = "\"" + name + "\":";
+    auto pos = json.find(key);
+    if (pos == std::string::npos)
+        return "";
+    pos += key.size();
+    if (json[pos] == '"') {
+        const auto end = json.find('"', pos + 1);
+        return json.substr(pos + 1, end - pos - 1);
+    }
+    const auto end = json.find_first_of(",}", pos);
+    return json.substr(pos, end - pos);
+}
+
+bool parse(const std::string & line, Result & result) {
+    if (line.empty() || line[0] != '{' || field(line, "rule").empty())
+        return false;
+    result.json = line;
+    result.rule = field(line, "rule");
+    result.engine = field(line, "engine");
+    result.columns = std::atol(field(line, "columns").c_str());
+    result.rows = std::atol(field(line, "rows").c_str());
+    result.threads = std::atol(field(line, "threads").c_str());
+    result.per_second = std::atof(field(line, "per_second").c_str());
+    return true;
+}
+
+std::vector<Result> load(const std::string & filename) {
+    std::vector<Result> results;
+    std::ifstream file{filename};
+    std::string line;
+    while (std::getline(file, line)) {
+        line.erase(0, line.find_first_not_of(" \t,["));
+        while (!line.empty() && (line.back() == ',' || line.back() == ']'))
+            line.pop_back();
+        Result result;
+        if (parse(line, result))
+            results.push_back(result);
+    }
+    return results;
+}
+
+bool run(const std::string & binary, const int threads, const long generations,
+         Result & result)
+{
+    const auto command = "CASE_THREADS=" + std::to_string(threads)
+                       + " CASE_GENERATIONS=" + std::to_string(generations)
+                       + " " + binary;
+    auto pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr)
+        return false;
+    auto found = false;
+    char buffer[4096];
+    while (std::fgets(buffer, sizeof buffer, pipe) != nullptr) {
+        std::string line{buffer};
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+            line.pop_back();
+        if (parse(line, result))
+            found = true;
+    }
+    return pclose(pipe) == 0 && found;
+}
+
+std::vector<int> split(const std::string & list) {
+    std::vector<int> values;
+    std::stringstream stream{list};
+    std::string item;
+    while (std::getline(stream, item, ','))
+        values.push_back(std::atoi(item.c_str()));
+    return values;
+}
+
+int main(int argc, char ** argv) {
+    long generations = 100;
+    std::vector<int> thread_counts;
+    std::string output = "bench/results.json";
+    std::string baseline = "bench/baseline.json";
+    double tolerance = 0.10;
+    std::vector<std::string> binaries;
+
+    for (auto i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const auto has_value = i + 1 < argc;
+        if (arg == "-g" && has_value)
+            generations = std::atol(argv[++i]);
+        else if (arg == "-t" && has_value)
+            thread_counts = split(argv[++i]);
+        else if (arg == "-o" && has_value)
+            output = argv[++i];
+        else if (arg == "-b" && has_value)
+            baseline = argv[++i];
+        else if (arg == "-r" && has_value)
+            tolerance = std::atof(argv[++i]);
+        else
+            binaries.push_back(arg);
+    }
+    if (thread_counts.empty()) {
+        const int max = std::max<int>(std::thread::hardware_concurrency(), 1);
+        for (auto t = 1; t < max; t *= 2)
+            thread_counts.push_back(t);
+        thread_counts.push_back(max);
+    }
+
+    std::vector<Result> results;
+    std::map<std::tuple<std::string, long, long, long>, bool> seen;
+    for (const auto & binary : binaries) {
+        for (const auto threads : thread_counts) {
+            Result result;
+            if (run(binary, threads, generations, result) == false) {
+                std::cerr << binary << " failed with " << threads
+                          << " threads\n";
+                return 2;
+            }
+            // the dynamic engine runs single threaded whatever is asked
+            if (seen[result.key()])
+                continue;
+            seen[result.key()] = true;
+            results.push_back(result);
+        }
+    }
+
+    // scaling efficiency relative to the lowest thread count of each run
+    for (auto & r : results) {
+        const Result * base = nullptr;
+        for (const auto & b : results) {
+            if (b.rule == r.rule && b.columns == r.columns && b.rows == r.rows
+                && (base == nullptr || b.threads < base->threads))
+                base = &b;
+        }
+        if (base != nullptr && base->per_second > 0)
+            r.efficiency = (r.per_second / base->per_second)
+                         * double(base->threads) / r.threads;
+    }
+
+    std::ofstream out{output};
+    out << "[\n";
+    for (auto i = 0u; i < results.size(); i++) {
+        auto json = results[i].json;
+        json.pop_back();
+        char extra[64];
+        std::snprintf(extra, sizeof extra, ",\"efficiency\":%.3f}",
+                      results[i].efficiency);
+        out << json << extra << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    out << "]\n";
+
+    std::printf("%-22s %6s %6s %8s %16s %6s %9s\n", "rule", "cols", "rows",
+                "threads", "units/s", "eff", "baseline");
+    const auto reference = load(baseline);
+    auto regressions = 0;
+    for (const auto & r : results) {
+        char versus[32] = "-";
+        for (const auto & b : reference) {
+            if (b.key() != r.key() || b.per_second <= 0)
+                continue;
+            const auto ratio = r.per_second / b.per_second;
+            std::snprintf(versus, sizeof versus, "%+.1f%%", 100 * (ratio - 1));
+            if (ratio < 1.0 - tolerance) {
+                regressions++;
+                std::strcat(versus, " !");
+            }
+        }
+        std::printf("%-22s %6ld %6ld %8ld %16.0f %6.2f %9s\n", r.rule.c_str(),
+                    r.columns, r.rows, r.threads, r.per_second, r.efficiency,
+                    versus);
+    }
+
+    std::cout << "results written to " << output << "\n";
+    if (reference.empty())
+        std::cout << "no baseline in " << baseline
+                  << ", run make bench-baseline to store one\n";
+    else if (regressions > 0) {
+        std::cout << regressions << " regressions beyond "
+                  << 100 * tolerance << "%\n";
+        return 1;
+    }
+}
@@ -4,6 +4,7 @@
 #ifndef CASE_CELL
 #define CASE_CELL
 
+#include <type_traits>
 #include <vector>
 #include <SFML/Graphics/Vertex.hpp>
 
@@ -12,31 +13,46 @@
 
 namespace CASE {
 
-template <class T, int LAYERS>
+// INDEX is the type of cell and agent indices, use a signed 64-bit type,
+// such as long long, for worlds of 2^31 or more cells or agents. FIELDS
+// is the number of dense scalar fields of the grid that agents read and
+// write through field(), see fields.hpp. CHUNKED cells are those of a
+// ChunkedGrid, see ChunkedZCell.
+template <class T, int LAYERS, class INDEX = int, int FIELDS = 0,
+          bool CHUNKED = false>
 class ZCell {
 
     static_assert(LAYERS > 0, "ZCell LAYERS must be > 0.");
+    static_assert(FIELDS >= 0, "ZCell FIELDS must be >= 0.");
+    static_assert(FIELDS == 0 || CHUNKED == false,
+                  "Chunked cells have no fields.");
+    static_assert(std::is_signed<INDEX>::value,
+                  "ZCell INDEX must be signed, neighbours are found by "
+                  "negative offsets.");
     T * array[LAYERS];
-    AgentManager<T> * manager = nullptr;
+    AgentManager<T, INDEX> * manager = nullptr;
 
 public:
     using Agent = T;
+    using Index = INDEX;
     static constexpr int depth = LAYERS;
+    static constexpr int fields = FIELDS;
+    static constexpr bool chunked = CHUNKED;
     int x = 0, y = 0;
-    int index = 0;
+    Index index = 0;
 
     ZCell() {
         for (auto i = 0; i < depth; i++)
             array[i] = nullptr;
     }
 
-    ZCell(AgentManager<Agent> & am) {
+    ZCell(AgentManager<Agent, Index> & am) {
         set_manager(am);
         for (auto i = 0; i < depth; i++)
             array[i] = nullptr;
     }
 
-    inline void set_manager(AgentManager<Agent> & am) {
+    inline void set_manager(AgentManager<Agent, Index> & am) {
         manager = &am;
     }
 
@@ -70,7 +86,7 @@ public:
     }
 
     auto neighbors() {
-        return Neighbors<ZCell<Agent, depth>>{this};
+        return Neighbors<ZCell>{this};
     }
 
     Agent * getlayer(const int layer) {
@@ -89,6 +105,26 @@ public:
         return getlayer(layer);
     }
 
+    // how Adjacent finds the neighbours of chunked cells
+    const Locator * locator() const {
+        assert(manager != nullptr);
+        return &manager->locator;
+    }
+
+    float & field(const int f) {
+        assert(f >= 0);
+        assert(f < FIELDS);
+        assert(manager != nullptr && manager->field_arrays != nullptr);
+        return manager->field_arrays[f][index];
+    }
+
+    float field(const int f) const {
+        assert(f >= 0);
+        assert(f < FIELDS);
+        assert(manager != nullptr && manager->field_arrays != nullptr);
+        return manager->field_arrays[f][index];
+    }
+
     Agent * insert(Agent & agent) {
         const auto layer = agent.z;
 
@@ -120,6 +156,12 @@ public:
             return insert(*agent);
     }
 
+    // points the slot of an agent of this cell at where it has been moved
+    void relocate(Agent & agent) {
+        assert(agent.cell == this);
+        array[agent.z] = &agent;
+    }
+
     Agent * extract(const int layer) {
         assert(layer < LAYERS);
         assert(layer >= 0);
@@ -159,6 +201,11 @@ public:
     inline bool is_occupied() const { return !is_empty(); }
 };
 
+// The cell of a ChunkedGrid. Its neighbours in other chunks are found
+// through the grid, all others by index arithmetic like in a Grid.
+template <class T, int LAYERS, class INDEX = int>
+using ChunkedZCell = ZCell<T, LAYERS, INDEX, 0, true>;
+
 } // CASE
 
 #endif // CELL
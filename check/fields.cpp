@@ -0,0 +1,59 @@
+#include <cstdio>
+#include <cstdlib>
+#include <CASE/grid.hpp>
+#include <CASE/cell.hpp>
+
+// What agents write to a field through their cell must be what the next
+// step of the field starts from, and what they read after it.
+struct Agent {
+    using Cell = CASE::ZCell<Agent, 1, int, 1>;
+    int z = 0;
+    Cell * cell = nullptr;
+    bool active() const { return false; }
+    void activate() {}
+    void deactivate() {}
+    void draw(int, int, std::vector<sf::Vertex> &) const {}
+};
+
+// adds 7 to a field value through the cell and steps, generations times
+bool carries(CASE::Grid<Agent::Cell> & grid, const int generations) {
+    // nothing but the clamp to capacity, so the values carry over unchanged
+    const std::vector<CASE::FieldRule> rules{{0, 0, 0, 0, 100}};
+
+    for (auto generation = 0; generation < generations; generation++) {
+        auto & cell = grid(2, 1);
+        cell.field(0) += 7.0f;
+        grid.fields.step(rules, 0, grid.fields.height());
+        grid.fields.flip();
+        const auto expected = 7.0f * (generation + 1);
+        if (grid(2, 1).field(0) != expected
+            || grid.fields[0][cell.index] != expected)
+        {
+            std::printf("fields: write lost in generation %d\n", generation);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main() {
+    CASE::AgentManager<Agent> manager{1};
+    CASE::Grid<Agent::Cell> grid{4, 4, manager};
+    if (!carries(grid, 3))
+        return EXIT_FAILURE;
+
+    // grids of one cell type have fields of their own, and outlive each other
+    {
+        CASE::AgentManager<Agent> other_manager{1};
+        CASE::Grid<Agent::Cell> other{4, 4, other_manager};
+        if (!carries(other, 2) || grid(2, 1).field(0) != 21.0f) {
+            std::printf("fields: grids of one cell type share fields\n");
+            return EXIT_FAILURE;
+        }
+    }
+    if (grid(2, 1).field(0) != 21.0f) {
+        std::printf("fields: lost when another grid was destroyed\n");
+        return EXIT_FAILURE;
+    }
+    std::printf("fields ok\n");
+}
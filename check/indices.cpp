@@ -0,0 +1,69 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <CASE/grid.hpp>
+#include <CASE/cell.hpp>
+
+// Worlds with 64-bit indices must find the same neighbours as with int,
+// including across the edges, where the offsets are negative.
+struct Agent {
+    using Cell = CASE::ZCell<Agent, 1, long long>;
+    int z = 0;
+    Cell * cell = nullptr;
+    bool alive = false;
+    bool active() const { return alive; }
+    void activate() { alive = true; }
+    void deactivate() { alive = false; }
+    void draw(int, int, std::vector<sf::Vertex> &) const {}
+};
+
+// a Static agent, whose index type is that of its index member
+struct Point {
+    long long index = 0;
+};
+
+int main() {
+    constexpr int columns = 5, rows = 4;
+    static_assert(std::is_same<CASE::index_type<Point>::type, long long>::value,
+                  "Point has 64-bit indices");
+
+    CASE::AgentManager<Agent, long long> manager{8};
+    CASE::Grid<Agent::Cell> grid{columns, rows, manager};
+    CASE::Neighbors<Agent::Cell>::columns = columns;
+    CASE::Neighbors<Agent::Cell>::rows = rows;
+
+    std::vector<Point> points(columns * rows);
+    for (std::size_t i = 0; i < points.size(); i++)
+        points[i].index = static_cast<long long>(i);
+
+    auto failures = 0;
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++) {
+            auto neighbors = grid(x, y).neighbors();
+            const auto adjacent = CASE::CAdjacent<Point>{
+                &points[CASE::index(x, y, columns)], columns, rows};
+            for (auto dy = -1; dy <= 1; dy++) {
+                for (auto dx = -1; dx <= 1; dx++) {
+                    const auto & expected = grid(x + dx, y + dy);
+                    const auto & cell = neighbors(dx, dy);
+                    const auto & point = adjacent(dx, dy);
+                    if (&cell != &expected || point.index != expected.index)
+                        failures++;
+                }
+            }
+        }
+    }
+    if (failures > 0) {
+        std::printf("indices: %d wrong neighbours\n", failures);
+        return EXIT_FAILURE;
+    }
+
+    if (grid(0, 0).spawn(Agent{}) == nullptr
+        || grid(0, 0).neighbors()(-1, -1).spawn(Agent{}) == nullptr
+        || grid(columns - 1, rows - 1).is_empty())
+    {
+        std::printf("indices: spawn across the edge failed\n");
+        return EXIT_FAILURE;
+    }
+    std::printf("indices ok\n");
+}
@@ -0,0 +1,101 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <CASE/random.hpp>
+#include <CASE/grid.hpp>
+#include <CASE/cell.hpp>
+#include <CASE/atomic_cell.hpp>
+
+// Agents that move, breed and die on several workers at once must still
+// each hold one slot of one cell, and the cells must count exactly the
+// live agents. Built with -DCONCURRENT, see the Makefile, like the Foxes
+// demo; without it the same agents run serially.
+struct Agent {
+#ifdef CONCURRENT
+    using Cell = CASE::AtomicZCell<Agent, 1>;
+    using Manager = CASE::AgentPool<Agent>;
+#else
+    using Cell = CASE::ZCell<Agent, 1>;
+    using Manager = CASE::AgentManager<Agent>;
+#endif
+    int z = 0;
+    int energy = 8;
+    Cell * cell = nullptr;
+    bool alive = false;
+    bool active() const { return alive; }
+    void activate() { alive = true; }
+    void deactivate() { alive = false; }
+    void draw(int, int, std::vector<sf::Vertex> &) const {}
+
+    void update() {
+        if (--energy <= 0)
+            return deactivate();
+        static thread_local CASE::Uniform<-1, 1> uv;
+        static thread_local CASE::Uniform<0, 3> breed;
+        auto neighbors = CASE::Neighbors<Cell>{cell};
+        if (breed() == 0)
+            neighbors(uv(), uv()).spawn(Agent{});
+        neighbors(uv(), uv()).insert(this);
+    }
+};
+
+// the number of broken invariants
+int check(const Agent::Manager & manager, CASE::Grid<Agent::Cell> & grid,
+          const int columns, const int rows, const bool sorted)
+{
+    auto errors = 0;
+    long long live = 0;
+    const auto agents = manager.data();
+    for (auto i = 0; i < manager.capacity(); i++) {
+        const auto & agent = agents[i];
+        if (agent.active() == false)
+            continue;
+        live++;
+        // another agent in its slot would have taken it from this one
+        if (agent.cell == nullptr || (*agent.cell)[agent.z] != &agent)
+            errors++;
+    }
+    long long counted = 0;
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++)
+            counted += grid(x, y).popcount();
+    }
+    if (counted != live)
+        errors++;
+    // dead agents are only returned to the manager when it sorts
+    if (sorted && manager.popcount() != live)
+        errors++;
+    return errors;
+}
+
+int main() {
+    constexpr int columns = 48, rows = 48;
+    setenv("CASE_THREADS", "4", 0);
+    CASE::Neighbors<Agent::Cell>::columns = columns;
+    CASE::Neighbors<Agent::Cell>::rows = rows;
+
+    Agent::Manager manager{columns * rows};
+    CASE::Grid<Agent::Cell> grid{columns, rows, manager};
+    for (auto y = 0; y < rows; y += 2) {
+        for (auto x = 0; x < columns; x += 2)
+            grid(x, y).spawn(Agent{});
+    }
+
+    for (auto generation = 0; generation < 200; generation++) {
+        manager.update();
+        const auto sorted = generation % 4 == 3;
+        if (sorted)
+            manager.sort();
+        const auto errors = check(manager, grid, columns, rows, sorted);
+        if (errors > 0) {
+            std::printf("pool: %d broken invariants in generation %d\n",
+                        errors, generation);
+            return EXIT_FAILURE;
+        }
+    }
+    if (manager.popcount() == 0) {
+        std::printf("pool: the agents died out, nothing was checked\n");
+        return EXIT_FAILURE;
+    }
+    std::printf("pool ok\n");
+}
@@ -0,0 +1,102 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_CHUNK
+#define CASE_CHUNK
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace CASE {
+
+// n / d rounded towards negative infinity, so that cell -1 is in chunk -1
+inline long long floor_div(const long long n, const long long d) {
+    return n >= 0 ? n / d : -((-n + d - 1) / d);
+}
+
+inline std::uint64_t chunk_key(const int cx, const int cy) {
+    return (std::uint64_t(std::uint32_t(cx)) << 32) | std::uint32_t(cy);
+}
+
+// Owns the chunks of a sparse world, keyed by chunk coordinates. A small
+// direct mapped cache sits in front of the hash map, since lookups come in
+// bursts for the same few chunks as updates walk along chunk borders.
+template <class Chunk>
+class ChunkMap {
+    static constexpr int cache_size = 256;
+
+    struct Entry {
+        std::uint64_t key = 0;
+        Chunk * chunk = nullptr;
+    };
+
+    std::unordered_map<std::uint64_t, std::unique_ptr<Chunk>> chunks;
+    Entry cache[cache_size];
+
+    static int slot(const std::uint64_t key) {
+        return (key ^ (key >> 29) ^ (key >> 41)) & (cache_size - 1);
+    }
+
+public:
+    Chunk * find(const int cx, const int cy) {
+        const auto key = chunk_key(cx, cy);
+        auto & entry = cache[slot(key)];
+        if (entry.chunk != nullptr && entry.key == key)
+            return entry.chunk;
+
+        const auto it = chunks.find(key);
+        if (it == chunks.end())
+            return nullptr;
+        entry.key = key;
+        entry.chunk = it->second.get();
+        return entry.chunk;
+    }
+
+    // as find(), but leaves the cache as it is
+    const Chunk * find(const int cx, const int cy) const {
+        const auto key = chunk_key(cx, cy);
+        const auto & entry = cache[slot(key)];
+        if (entry.chunk != nullptr && entry.key == key)
+            return entry.chunk;
+
+        const auto it = chunks.find(key);
+        return it == chunks.end() ? nullptr : it->second.get();
+    }
+
+    Chunk * insert(const int cx, const int cy, std::unique_ptr<Chunk> chunk) {
+        auto pointer = chunk.get();
+        chunks[chunk_key(cx, cy)] = std::move(chunk);
+        return pointer;
+    }
+
+    void erase(const int cx, const int cy) {
+        const auto key = chunk_key(cx, cy);
+        auto & entry = cache[slot(key)];
+        if (entry.key == key)
+            entry.chunk = nullptr;
+        chunks.erase(key);
+    }
+
+    void clear() {
+        chunks.clear();
+        for (auto & entry : cache)
+            entry.chunk = nullptr;
+    }
+
+    std::size_t size() const { return chunks.size(); }
+
+    // a snapshot of the chunks, which stays valid while inserting
+    std::vector<Chunk *> list() const {
+        std::vector<Chunk *> result;
+        result.reserve(chunks.size());
+        for (const auto & pair : chunks)
+            result.push_back(pair.second.get());
+        return result;
+    }
+};
+
+} // CASE
+
+#endif // CASE_CHUNK
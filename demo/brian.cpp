@@ -1,11 +1,16 @@
 #include <CASE/random.hpp>
 #include <CASE/neighbors.hpp>
+#include <CASE/stencil.hpp>
 #include <CASE/quad.hpp>
 #include <CASE/grid.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 500
+#endif
+#ifndef ROWS
 #define ROWS 500
+#endif
 #define CELL_SIZE 2
 
 class Brian {
@@ -22,8 +27,7 @@ public:
         state = Dead;
     }
 
-    void update(Brian & next) const {
-        auto neighbors = CASE::CAdjacent<Brian>{this};
+    void update(Brian & next, const CASE::Stencil<Brian> & neighbors) const {
         static const int range[3] = {-1, 0, 1};
         auto count = 0;
         for (const auto y : range) {
@@ -80,6 +84,7 @@ struct BriansBrain {
     }
 
     void postprocessing(Agent *) {}
+    void postprocessing(Agent *, int, int) {}
 };
 
 int main() {
@@ -4,8 +4,12 @@
 #include <CASE/grid.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 512
+#endif
+#ifndef ROWS
 #define ROWS 512
+#endif
 #define CELL_SIZE 2
 
 struct Color {
@@ -28,7 +32,7 @@ public:
     }
 
     void update(Automata & next) const {
-        auto neighbors = CASE::CAdjacent<Automata>{this, COLUMNS, ROWS};
+        auto neighbors = CASE::CAdjacent<Automata, COLUMNS, ROWS>{this};
         Color colors[6] = {0,1,2,3,4,5};
         static const int range[3] = {-1, 0, 1};
         for (const auto Y : range) {
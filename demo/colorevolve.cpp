@@ -6,8 +6,12 @@
 #include <CASE/helper.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 512
+#endif
+#ifndef ROWS
 #define ROWS 512
+#endif
 #define CELL_SIZE 2
 
 int mfactor = 10, start_r = 255, start_g = 255, start_b = 255;
@@ -45,7 +49,7 @@ public:
 void Bacteria::update(Bacteria & next) const {
     if (active())
         return;
-    auto neighbors = CASE::CAdjacent<Bacteria>{this, COLUMNS, ROWS};
+    auto neighbors = CASE::CAdjacent<Bacteria, COLUMNS, ROWS>{this};
     bool alone = true;
     for (auto y = -1; y <= 1; y++) {
         for (auto x = -1; x <= 1; x++) {
@@ -92,6 +96,7 @@ struct Config {
     }
 
     void postprocessing(Agent *) {
+#ifndef CASE_HEADLESS
         if (sf::Keyboard::isKeyPressed(sf::Keyboard::PageUp)) {
             mfactor = CASE::clamp<0,100>(mfactor + 1);
             std::cout << "Mutation Factor  " << mfactor << std::endl;
@@ -106,6 +111,7 @@ struct Config {
         if (sf::Keyboard::isKeyPressed(sf::Keyboard::W)) {
             start_r = 255; start_g = 255; start_b = 255;
         }
+#endif
     }
 };
 
@@ -0,0 +1,58 @@
+#include <iostream>
+
+#include <CASE/line_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 600
+#endif
+#ifndef ROWS
+#define ROWS 300
+#endif
+#ifndef STATES
+#define STATES 2
+#endif
+#define CELL_SIZE 2
+
+// Wolfram's elementary rules on a line, PageDown and PageUp step through
+// all 256 of them. With STATES above 2 the code is that of a totalistic
+// rule of that many states instead.
+struct Elementary {
+    const int columns = COLUMNS;
+    const int rows = ROWS;
+    const int cell_size = CELL_SIZE;
+    double framerate = 100.0;
+    const char* title = "Elementary rules";
+    const sf::Color bgcolor = sf::Color{220, 220, 220};
+    int code = STATES == 2 ? 30 : 1635;
+    CASE::LineRule rule = make_rule(code);
+
+    static CASE::LineRule make_rule(const int code) {
+        if (STATES == 2)
+            return CASE::elementary_rule(code & 255);
+        return CASE::totalistic_rule(STATES, 1, code);
+    }
+
+    void init(CASE::LineWorld & world) {
+        world.set(COLUMNS / 2, STATES - 1);
+    }
+
+    void postprocessing(CASE::LineWorld &) {
+#ifndef CASE_HEADLESS
+        static bool pressed = false;
+        const auto down = sf::Keyboard::isKeyPressed(sf::Keyboard::PageDown);
+        const auto up = sf::Keyboard::isKeyPressed(sf::Keyboard::PageUp);
+        if ((down || up) && !pressed) {
+            code = down ? code + 1 : code - 1;
+            if (STATES == 2)
+                code &= 255;
+            rule = make_rule(code);
+            std::cout << code << std::endl;
+        }
+        pressed = down || up;
+#endif
+    }
+};
+
+int main() {
+    CASE::Line<Elementary>();
+}
@@ -3,10 +3,15 @@
 #include <CASE/random.hpp>
 #include <CASE/grid.hpp>
 #include <CASE/cell.hpp>
+#include <CASE/atomic_cell.hpp>
 #include <CASE/dynamic_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 300
+#endif
+#ifndef ROWS
 #define ROWS 300
+#endif
 #define CELL_SIZE 2
 
 enum Type { Fox, Rabbit, Grass, None };
@@ -16,7 +21,12 @@ class Agent {
     bool alive = false;
 
 public:
+#ifdef CONCURRENT
+    // updated by several threads at once, see AgentPool
+    using Cell = CASE::AtomicZCell<Agent, 2>;
+#else
     using Cell = CASE::ZCell<Agent, 2>;
+#endif
 
     Type type;
     int z = 0;
@@ -33,7 +43,7 @@ public:
 };
 
 Agent::Agent(const Type _type) {
-    static CASE::Uniform<0, 100> dist;
+    static thread_local CASE::Uniform<0, 100> dist;
     if (_type == None) {
         auto r = dist();
         if (r > 99)         type = Fox;
@@ -60,9 +70,9 @@ void Agent::update() {
     if (energy <= 0)
         return deactivate();
 
-    auto neighbors = cell->neighbors();
-    static CASE::Uniform<-1, 1> uv;
-    static CASE::Uniform<0, 100> rand_percent{};
+    auto neighbors = CASE::Neighbors<Cell, COLUMNS, ROWS>{cell};
+    static thread_local CASE::Uniform<-1, 1> uv;
+    static thread_local CASE::Uniform<0, 100> rand_percent{};
 
     if (type == Grass) {
         auto grass = neighbors(uv(), uv()).getlayer(1);
@@ -138,7 +148,7 @@ void Agent::draw(const int x, const int y, std::vector<sf::Vertex> & vs) const {
 struct Config {
     using Agent = FoxesAndRabbits::Agent;
     using Cell = Agent::Cell;
-    using Grid = CASE::Grid<Cell>;
+    using Grid = CASE::Grid<Cell, COLUMNS, ROWS>;
     static constexpr int columns = COLUMNS;
     static constexpr int rows = ROWS;
     static constexpr int cell_size = CELL_SIZE;
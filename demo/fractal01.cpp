@@ -5,8 +5,12 @@
 #include <CASE/grid.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 21
+#endif
+#ifndef ROWS
 #define ROWS 21
+#endif
 #define CELL_SIZE 15
 
 class Automaton {
@@ -22,7 +26,7 @@ public:
 
     void update(Automaton & next) const {
         if (live == false) {
-            auto neighbors = CASE::CAdjacent<Automaton>{this};
+            auto neighbors = CASE::CAdjacent<Automaton, COLUMNS, ROWS>{this};
             static const int dirs[4][2] = {
                 {0,-1}, {1,0}, {0,1}, {-1,0}
             };
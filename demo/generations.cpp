@@ -0,0 +1,40 @@
+#include <CASE/random.hpp>
+#include <CASE/generations_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 500
+#endif
+#ifndef ROWS
+#define ROWS 500
+#endif
+#ifndef RULE
+#define RULE "/2/3"
+#endif
+#define CELL_SIZE 2
+
+// Brian's Brain on bit planes, or any other Generations rule given as
+// -DRULE='"345/2/4"' (Star Wars) in S/B/C notation.
+struct Generations {
+    const int columns = COLUMNS;
+    const int rows = ROWS;
+    const int cell_size = CELL_SIZE;
+    double framerate = 60.0;
+    const char* title = "Generations";
+    const sf::Color bgcolor = sf::Color::White;
+    CASE::GenerationsRule rule = CASE::generations_rule(RULE);
+
+    void init(CASE::GenerationsWorld & world) {
+        CASE::Gaussian<(COLUMNS+ROWS)/4, 25> random;
+        for (auto i = 0; i < 250; i++) {
+            const auto x = CASE::wrap(random(), columns),
+                       y = CASE::wrap(random(), rows);
+            world.set(x, y, 1);
+        }
+    }
+
+    void postprocessing(CASE::GenerationsWorld &) {}
+};
+
+int main() {
+    CASE::Generations<Generations>();
+}
@@ -0,0 +1,148 @@
+#include <CASE/quad.hpp>
+#include <CASE/index.hpp>
+#include <CASE/random.hpp>
+#include <CASE/grid.hpp>
+#include <CASE/cell.hpp>
+#include <CASE/dynamic_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 300
+#endif
+#ifndef ROWS
+#define ROWS 300
+#endif
+#define CELL_SIZE 2
+
+// Foxes and rabbits on a field of grass, which spreads and regrows on its
+// own between the moves of the animals instead of being agents.
+enum Type { Fox, Rabbit, None };
+
+namespace Grazing {
+class Agent {
+    bool alive = false;
+
+public:
+    // one layer of animals and one field, the grass
+    using Cell = CASE::ZCell<Agent, 1, int, 1>;
+
+    Type type;
+    int z = 0;
+    int max_energy = 255;
+    int energy = max_energy;
+    Cell * cell = nullptr;
+
+    Agent(Type type = Type::None);
+    void update();
+    void draw(const int, const int, std::vector<sf::Vertex> & vertices) const;
+    bool active() const { return alive; }
+    void activate() { alive = true; }
+    void deactivate() { alive = false; }
+};
+
+Agent::Agent(const Type _type) {
+    static CASE::Uniform<0, 9> dist;
+    if (_type == None)
+        type = dist() == 0 ? Fox : Rabbit;
+    else
+        this->type = _type;
+    energy = type == Rabbit ? 255 : 200;
+}
+
+void Agent::update() {
+    if (energy <= 0)
+        return deactivate();
+
+    auto neighbors = CASE::Neighbors<Cell, COLUMNS, ROWS>{cell};
+    static CASE::Uniform<-1, 1> uv;
+    static CASE::Uniform<0, 100> rand_percent{};
+
+    if (type == Rabbit) {
+        energy -= 6;
+        bool breed = rand_percent() < 10 && energy > 0.7 * max_energy;
+        if (breed) {
+            auto rabbit = neighbors(uv(), uv()).spawn(Agent{Rabbit});
+            if (rabbit != nullptr) {
+                rabbit->energy = energy;
+                energy -= 20;
+            }
+        }
+        auto & grass = cell->field(0);
+        energy += static_cast<int>(grass);
+        grass = std::max(grass - 50.0f, 0.0f);
+        neighbors(uv(), uv()).insert(this);
+    }
+    else { // type is Fox
+        energy -= 10;
+        const auto breed = rand_percent() < 5 && energy > 0.75 * max_energy;
+        if (breed) {
+            if (neighbors(uv(), uv()).spawn(Agent{Fox}) != nullptr)
+                energy -= 10;
+        }
+        for (Cell * cellptr : neighbors.cells()) {
+            auto ptr = cellptr->getlayer(0);
+            if (ptr == nullptr)
+                continue;
+
+            auto & agent = *ptr;
+            if (agent.type == Rabbit) {
+                energy += 50;
+                agent.energy = 0;
+                break;
+            }
+        }
+        neighbors(uv(), uv()).insert(this);
+    }
+}
+
+void Agent::draw(const int x, const int y, std::vector<sf::Vertex> & vs) const {
+    const auto i = vs.size();
+    vs.resize(vs.size() + 4);
+
+    if (type == Rabbit)
+        CASE::quad(x*CELL_SIZE, y*CELL_SIZE, CELL_SIZE, CELL_SIZE, 0, 155, 255, &vs[i]);
+    else
+        CASE::quad(x*CELL_SIZE, y*CELL_SIZE, CELL_SIZE, CELL_SIZE, 255, 100, 0, &vs[i]);
+}
+} // Grazing
+
+struct Config {
+    using Agent = Grazing::Agent;
+    using Cell = Agent::Cell;
+    using Grid = CASE::Grid<Cell, COLUMNS, ROWS>;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    static constexpr int cell_size = CELL_SIZE;
+    const double framerate = 60;
+    const char* title = "Grazing";
+    const sf::Color bgcolor{0,0,0};
+
+    // grass spreads to bare cells and regrows logistically up to 255
+    std::vector<CASE::FieldRule> fields{{0.05f, 0.0f, 0.02f, 0.0f, 255.0f}};
+
+    sf::Color background(const Cell & cell) const {
+        const auto grass = cell.field(0);
+        if (grass < 1.0f)
+            return sf::Color{0, 0, 0};
+        return sf::Color{0, static_cast<std::uint8_t>(230 - 0.5f * grass), 0};
+    }
+
+    void init(Grid & grid, CASE::AgentManager<Agent> & manager) {
+        grid.clear();
+        manager.clear();
+        CASE::Uniform<0, columns - 1> x;
+        CASE::Uniform<0, rows - 1> y;
+        CASE::Uniform<0, 100> percent;
+        for (auto i = 0; i < (COLUMNS*ROWS)/10; i++)
+            grid(x(), y()).spawn(Agent{None});
+        for (auto i = 0; i < COLUMNS*ROWS; i++) {
+            if (percent() < 60)
+                grid.fields[0][i] = 50.0f;
+        }
+    }
+
+    void postprocessing(Grid & /*grid*/) {}
+};
+
+int main() {
+    CASE::Dynamic<Config>();
+}
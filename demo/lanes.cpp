@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <CASE/random.hpp>
+#include <CASE/index.hpp>
+#include <CASE/batch_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 21
+#endif
+#ifndef ROWS
+#define ROWS 21
+#endif
+#ifndef RUNS
+#define RUNS 512
+#endif
+#ifndef GENERATIONS
+#define GENERATIONS 2000
+#endif
+
+// The rules of speed_of_light and fractal01 on plain cells, started from a
+// few random live cells, run once world by world and once 32 worlds at a
+// time, which must end in the same worlds.
+struct Light {
+    using State = std::uint8_t;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    const char * title = "Speed of Light";
+
+    void init(State * cells) {
+        CASE::Uniform<0, COLUMNS * ROWS - 1> rand;
+        for (auto i = 0; i < columns * rows; i++)
+            cells[i] = 0;
+        cells[rand()] = 1;
+    }
+
+    template <class V, class W>
+    V rule(const V & cell, const W & neighbors) const {
+        return cell | neighbors(-1, 0) | neighbors(0, -1)
+                    | neighbors(1, 0) | neighbors(0, 1);
+    }
+};
+
+struct Fractal {
+    using State = std::uint8_t;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    const char * title = "Game of Automaton";
+
+    void init(State * cells) {
+        CASE::Uniform<0, COLUMNS * ROWS - 1> rand;
+        for (auto i = 0; i < columns * rows; i++)
+            cells[i] = 0;
+        for (auto i = 0; i < 3; i++)
+            cells[rand()] = 1;
+    }
+
+    template <class V, class W>
+    V rule(const V & cell, const W & neighbors) const {
+        const V count = neighbors(0, -1) + neighbors(1, 0)
+                      + neighbors(0, 1) + neighbors(-1, 0);
+        const V born = (cell == V(0)) & ((count == V(1)) | (count == V(4)));
+        return CASE::choose(born, V(1), cell);
+    }
+
+    // fraction of live cells
+    double summary(const State * cells) const {
+        auto live = 0;
+        for (auto i = 0; i < columns * rows; i++)
+            live += cells[i];
+        return double(live) / (columns * rows);
+    }
+};
+
+template <int LANES, class Config>
+std::vector<CASE::EnsembleResult> run(const char * engine, int & matching,
+    const std::vector<CASE::EnsembleResult> * expected = nullptr)
+{
+    std::vector<Config> configs(RUNS);
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = CASE::Batched<LANES>(configs, GENERATIONS);
+    const std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+
+    std::uint64_t units = 0;
+    for (auto i = 0u; i < results.size(); i++) {
+        units += results[i].units;
+        if (expected != nullptr
+            && results[i].checksum == (*expected)[i].checksum)
+            matching++;
+    }
+    std::printf("{\"rule\":\"%s\",\"engine\":\"%s\",\"lanes\":%d,"
+                "\"runs\":%zu,\"seconds\":%.6f,\"unit\":\"cell\","
+                "\"units\":%llu,\"per_second\":%.1f",
+                configs.front().title, engine, LANES, results.size(),
+                seconds.count(), static_cast<unsigned long long>(units),
+                units / seconds.count());
+    if (expected != nullptr)
+        std::printf(",\"matching\":%d", matching);
+    std::printf("}\n");
+    return results;
+}
+
+template <class Config>
+int compare() {
+    auto matching = 0;
+    const auto alone = run<1, Config>("single", matching);
+    run<32, Config>("batched", matching, &alone);
+    return matching == RUNS ? 0 : 1;
+}
+
+int main() {
+    return compare<Light>() | compare<Fractal>();
+}
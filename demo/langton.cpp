@@ -7,8 +7,12 @@
 #include <CASE/cell.hpp>
 #include <CASE/dynamic_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 150
+#endif
+#ifndef ROWS
 #define ROWS 150
+#endif
 #define CELL_SIZE 4
 #define CELL_LAYER 1
 #define ANT_LAYER 0
@@ -23,7 +27,7 @@ class Agent {
 
 public:
     int z = 0;
-    using Cell = CASE::ZCell<Agent, 2>;
+    using Cell = CASE::ChunkedZCell<Agent, 2>;
     Cell * cell = nullptr;
 
     Agent(Type type = Type::Cell);
@@ -75,7 +79,8 @@ void Agent::draw(const int x, const int y, std::vector<sf::Vertex> & vs) const {
 struct Config {
     using Agent = Langton::Agent;
     using Cell = Agent::Cell;
-    using Grid = CASE::Grid<Cell>;
+    // the ant builds its highway off the screen instead of into its own trail
+    using Grid = CASE::ChunkedGrid<Cell, 32>;
 
     static constexpr int columns = COLUMNS;
     static constexpr int rows = ROWS;
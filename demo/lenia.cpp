@@ -0,0 +1,51 @@
+#include <CASE/random.hpp>
+#include <CASE/field_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 256
+#endif
+#ifndef ROWS
+#define ROWS 256
+#endif
+#ifndef RADIUS
+#define RADIUS 13
+#endif
+#define CELL_SIZE 3
+
+// Lenia with the kernel and growth of Orbium, from random patches.
+struct Lenia {
+    const int columns = COLUMNS;
+    const int rows = ROWS;
+    const int cell_size = CELL_SIZE;
+    double framerate = 30.0;
+    const char* title = "Lenia";
+    const sf::Color bgcolor = sf::Color::White;
+    const int channels = 1;
+    std::vector<CASE::Kernel> kernels{CASE::lenia_kernel(RADIUS)};
+    const float dt = 0.1f;
+    const CASE::LeniaGrowth lenia{0.15f, 0.015f};
+
+    float growth(const int, const float potential) const {
+        return lenia(potential);
+    }
+
+    void init(CASE::FieldWorld & world) {
+        CASE::Uniform<0, 1000> random;
+        for (auto patch = 0; patch < 8; patch++) {
+            const auto x0 = CASE::wrap(random(), columns);
+            const auto y0 = CASE::wrap(random(), rows);
+            for (auto y = 0; y < 2 * RADIUS; y++) {
+                for (auto x = 0; x < 2 * RADIUS; x++) {
+                    world(0, CASE::wrap(x0 + x, columns),
+                          CASE::wrap(y0 + y, rows)) = random() / 1000.0f;
+                }
+            }
+        }
+    }
+
+    void postprocessing(CASE::FieldWorld &) {}
+};
+
+int main() {
+    CASE::Continuous<Lenia>();
+}
@@ -1,11 +1,16 @@
 #include <CASE/random.hpp>
 #include <CASE/neighbors.hpp>
+#include <CASE/stencil.hpp>
 #include <CASE/quad.hpp>
 #include <CASE/grid.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 300
+#endif
+#ifndef ROWS
 #define ROWS 300
+#endif
 #define CELL_SIZE 2
 
 int clamp(int x) {
@@ -24,8 +29,7 @@ public:
     {
     }
 
-    void update(Life & next) const {
-        auto neighbors = CASE::CAdjacent<Life>{this};
+    void update(Life & next, const CASE::Stencil<Life> & neighbors) const {
         static const int range[3] = {-1, 0, 1};
         auto count = 0;
         for (const auto y : range) {
@@ -84,6 +88,7 @@ struct GameOfLife {
     }
 
     void postprocessing(Agent *) {}
+    void postprocessing(Agent *, int, int) {}
 };
 
 int main() {
@@ -0,0 +1,75 @@
+#include <CASE/random.hpp>
+#include <CASE/area.hpp>
+#include <CASE/quad.hpp>
+#include <CASE/static_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 400
+#endif
+#ifndef ROWS
+#define ROWS 400
+#endif
+#define CELL_SIZE 2
+
+// Bosco's rule of Larger than Life, R5,C0,M1,S34..58,B34..45: the cells
+// within 5 of a cell, itself included, are counted from a summed area table.
+class Bosco {
+    int x, y;
+
+public:
+    static constexpr int area_radius = 5;
+    bool live = false;
+    int index = 0;
+
+    Bosco(int _x = 0, int _y = 0) : x(CELL_SIZE * _x), y(CELL_SIZE * _y)
+    {
+    }
+
+    int area_value() const { return live; }
+
+    void update(Bosco & next, const CASE::Area<Bosco> & area) const {
+        const auto count = area.box(5);
+        if (live)
+            next.live = count >= 34 && count <= 58;
+        else
+            next.live = count >= 34 && count <= 45;
+    }
+
+    void draw(sf::Vertex * vs) const {
+        if (live)
+            CASE::quad(x, y, CELL_SIZE, CELL_SIZE, 0, 0, 0, vs);
+        else
+            CASE::quad(x, y, CELL_SIZE, CELL_SIZE, 255, 255, 255, vs);
+    }
+};
+
+struct LargerThanLife {
+    using Agent = Bosco;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    static constexpr int cell_size = CELL_SIZE;
+    double framerate = 30.0;
+    const char* title = "Larger than Life";
+    const sf::Color bgcolor = sf::Color::White;
+
+    void init(Bosco * agents) {
+        int index = 0;
+        CASE::Uniform<0, 100> dist;
+        for (auto y = 0; y < ROWS; y++) {
+            for (auto x = 0; x < COLUMNS; x++) {
+                auto & agent = agents[CASE::index(x, y, COLUMNS)];
+                agent = Bosco{x, y};
+                agent.index = index++;
+                const auto inside = std::abs(x - COLUMNS/2) < COLUMNS/4
+                                 && std::abs(y - ROWS/2) < ROWS/4;
+                agent.live = inside && dist() > 50;
+            }
+        }
+    }
+
+    void postprocessing(Agent *) {}
+};
+
+int main() {
+    CASE::Static<LargerThanLife>();
+}
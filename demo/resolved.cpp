@@ -0,0 +1,139 @@
+#include <CASE/quad.hpp>
+#include <CASE/random.hpp>
+#include <CASE/intent_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 300
+#endif
+#ifndef ROWS
+#define ROWS 300
+#endif
+#define CELL_SIZE 2
+
+// Foxes and Rabbits as intents: every agent decides from the last
+// generation, and conflicts are settled afterwards, so that the run is the
+// same for any number of threads.
+enum Type { Fox, Rabbit, Grass, None };
+
+class Agent {
+public:
+    using World = CASE::IntentWorld<Agent>;
+
+    Type type = None;
+    int z = 0;
+    int max_energy = 255;
+    int energy = max_energy;
+
+    Agent() {}
+    Agent(const Type t, const int e) : type(t), z(t == Grass), energy(e) {}
+
+    // grass regrows when rabbits pass grass on to it, and loses what
+    // they eat
+    void receive(const long amount) {
+        energy = static_cast<int>(std::min<long>(energy + amount, max_energy));
+    }
+
+    void act(Agent & next, const World::View & view,
+             World::Intents & intents) const;
+    void draw(const int x, const int y, std::vector<sf::Vertex> & vs) const;
+};
+
+void Agent::act(Agent & next, const World::View & view,
+                World::Intents & intents) const
+{
+    if (energy <= 0)
+        return intents.die();
+
+    const auto uv = [&view]() { return view.random(-1, 1); };
+    const auto percent = view.random(0, 100);
+
+    if (type == Grass) {
+        const auto dx = uv(), dy = uv();
+        if (view(dx, dy, 1) != nullptr)
+            intents.transfer(dx, dy, 1, 2);
+        else if (energy > 0.25 * max_energy)
+            intents.spawn(dx, dy, Agent{Grass, 50});
+    }
+    else if (type == Rabbit) {
+        next.energy -= 6;
+        if (percent < 10 && next.energy > 0.7 * max_energy) {
+            intents.spawn(uv(), uv(), Agent{Rabbit, next.energy});
+            next.energy -= 20;
+        }
+        const auto grass = view(0, 0, 1);
+        if (grass != nullptr) {
+            next.energy += grass->energy;
+            intents.transfer(0, 0, 1, -50);
+        }
+        intents.move(uv(), uv());
+    }
+    else { // type is Fox
+        next.energy -= 10;
+        if (percent < 5 && next.energy > 0.75 * max_energy) {
+            intents.spawn(uv(), uv(), Agent{Fox, 200});
+            next.energy -= 10;
+        }
+        for (auto dy = -1; dy <= 1; dy++) {
+            for (auto dx = -1; dx <= 1; dx++) {
+                const auto prey = view(dx, dy, 0);
+                if (prey != nullptr && prey->type == Rabbit) {
+                    next.energy += 50;
+                    intents.kill(dx, dy, 0);
+                    dy = 2;
+                    break;
+                }
+            }
+        }
+        intents.move(uv(), uv());
+    }
+}
+
+void Agent::draw(const int x, const int y, std::vector<sf::Vertex> & vs) const {
+    const auto i = vs.size();
+    vs.resize(vs.size() + 4);
+
+    int r = 0, g = 0, b = 0;
+    if (type == Grass)
+        g = -0.5 * energy + 230;
+
+    else if (type == Rabbit) {
+        g = 155;
+        b = 255;
+    }
+    else {
+        r = 255;
+        g = 100;
+    }
+
+    CASE::quad(x*CELL_SIZE, y*CELL_SIZE, CELL_SIZE, CELL_SIZE, r,g,b, &vs[i]);
+}
+
+struct Config {
+    using Agent = ::Agent;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    static constexpr int layers = 2;
+    static constexpr int cell_size = CELL_SIZE;
+    const double framerate = 60;
+    const char* title = "Foxes and Rabbits, resolved";
+    const sf::Color bgcolor{0,0,0};
+    const CASE::Resolution resolution = CASE::Resolution::Random;
+
+    void init(Agent::World & world) {
+        CASE::Uniform<0, columns - 1> x;
+        CASE::Uniform<0, rows - 1> y;
+        CASE::Uniform<0, 100> dist;
+        for (auto i = 0; i < COLUMNS*ROWS; i++) {
+            const auto r = dist();
+            if (r > 99)         world.spawn(x(), y(), Agent{Fox, 200});
+            else if (r > 90)    world.spawn(x(), y(), Agent{Rabbit, 255});
+            else                world.spawn(x(), y(), Agent{Grass, 50});
+        }
+    }
+
+    void postprocessing(Agent::World &) {}
+};
+
+int main() {
+    CASE::Resolved<Config>();
+}
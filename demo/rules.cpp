@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+
+#include <CASE/random.hpp>
+#include <CASE/table_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 300
+#endif
+#ifndef ROWS
+#define ROWS 300
+#endif
+#ifndef RULE
+#define RULE "B3/S23"
+#endif
+#define CELL_SIZE 2
+
+// Life, or any rule given as -DRULE='"B36/S23"' in B/S or S/B/C notation,
+// compiled to a table when the program starts. PageDown switches to a
+// random two state rule on the Moore neighbourhood and prints it.
+struct Rules {
+    const int columns = COLUMNS;
+    const int rows = ROWS;
+    const int cell_size = CELL_SIZE;
+    double framerate = 60.0;
+    const char* title = "Rule tables";
+    const sf::Color bgcolor = sf::Color::White;
+    CASE::TableRule rule = CASE::compile_rule(RULE);
+
+    void init(CASE::TableWorld & world) {
+        CASE::Uniform<0, 100> dist;
+        for (auto y = 0; y < rows; y++) {
+            for (auto x = 0; x < columns; x++) {
+                if (dist() > 50)
+                    world.set(x, y, 1);
+            }
+        }
+    }
+
+    void postprocessing(CASE::TableWorld &) {
+#ifndef CASE_HEADLESS
+        static bool pressed = false;
+        const auto down = sf::Keyboard::isKeyPressed(sf::Keyboard::PageDown);
+        if (down && !pressed && rule.states == 2) {
+            CASE::SBool coin;
+            std::string notation = "B";
+            for (auto n = 1; n <= 8; n++)
+                if (coin()) notation += std::to_string(n);
+            notation += "/S";
+            for (auto n = 0; n <= 8; n++)
+                if (coin()) notation += std::to_string(n);
+            std::cout << notation << std::endl;
+            rule = CASE::compile_rule(notation);
+        }
+        pressed = down;
+#endif
+    }
+};
+
+int main() {
+    CASE::Table<Rules>();
+}
@@ -0,0 +1,77 @@
+#include <CASE/neighbors.hpp>
+#include <CASE/quad.hpp>
+#include <CASE/sparse_sim.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 300
+#endif
+#ifndef ROWS
+#define ROWS 300
+#endif
+#define CELL_SIZE 2
+
+// Conways Life on an unbounded plane, the gliders of the R-pentomino leave
+// the window but keep their chunks alive until they are gone.
+class Life {
+    int x, y;
+
+public:
+    bool live = false;
+    int index = 0;
+
+    Life(long long _x = 0, long long _y = 0)
+        : x(CELL_SIZE * _x), y(CELL_SIZE * _y)
+    {
+    }
+
+    void update(Life & next) const {
+        auto neighbors = CASE::CAdjacent<Life>{this};
+        static const int range[3] = {-1, 0, 1};
+        auto count = 0;
+        for (const auto y : range) {
+            for (const auto x : range) {
+                if (x == 0 && y == 0) continue;
+                if (neighbors(x, y).live) count++;
+            }
+        }
+        next.live = count == 3 || (live && count == 2);
+    }
+
+    void draw(sf::Vertex * vs) const {
+        if (live)
+            CASE::quad(x, y, CELL_SIZE, CELL_SIZE, 255, 0, 0, vs);
+        else
+            CASE::quad(x, y, CELL_SIZE, CELL_SIZE, 240, 240, 240, vs);
+    }
+};
+
+struct SparseLife {
+    using Agent = Life;
+    using World = CASE::SparseWorld<SparseLife>;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    static constexpr int cell_size = CELL_SIZE;
+    double framerate = 60.0;
+    const char* title = "Sparse Life";
+    const sf::Color bgcolor = sf::Color::White;
+
+    Life create(const long long x, const long long y) const {
+        return Life{x, y};
+    }
+
+    bool empty(const Life & life) const {
+        return life.live == false;
+    }
+
+    void init(World & world) {
+        static const int pentomino[5][2] = {{1,0}, {2,0}, {0,1}, {1,1}, {1,2}};
+        for (const auto & cell : pentomino)
+            world(COLUMNS/2 + cell[0], ROWS/2 + cell[1]).live = true;
+    }
+
+    void postprocessing(World &) {}
+};
+
+int main() {
+    CASE::Sparse<SparseLife>();
+}
@@ -4,8 +4,12 @@
 #include <CASE/grid.hpp>
 #include <CASE/static_sim.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 21
+#endif
+#ifndef ROWS
 #define ROWS 21
+#endif
 #define CELL_SIZE 15
 
 class Light {
@@ -20,7 +24,7 @@ public:
     }
 
     void update(Light & next) const {
-        auto neighbors = CASE::CAdjacent<Light>{this};
+        auto neighbors = CASE::CAdjacent<Light, COLUMNS, ROWS>{this};
         next.live = live || neighbors(-1, 0).live || neighbors(0, -1).live
                     || neighbors(1, 0).live || neighbors(0, 1).live;
     }
@@ -0,0 +1,113 @@
+#include <chrono>
+#include <iostream>
+
+#include <CASE/random.hpp>
+#include <CASE/neighbors.hpp>
+#include <CASE/quad.hpp>
+#include <CASE/index.hpp>
+#include <CASE/ensemble.hpp>
+
+#ifndef COLUMNS
+#define COLUMNS 128
+#endif
+#ifndef ROWS
+#define ROWS 128
+#endif
+#ifndef GENERATIONS
+#define GENERATIONS 256
+#endif
+#define CELL_SIZE 2
+
+// A parameter sweep over Wolfram's rules and random first rows, every run
+// on its own core. The rule of a run is read from a thread local, set by
+// init() on the thread that runs it.
+thread_local int RULESET = 0;
+
+class Wolfram {
+    int x, y;
+
+public:
+    bool live = false;
+    bool scanline = false;
+    int index = 0;
+
+    Wolfram(int _x = 0, int _y = 0) : x(CELL_SIZE * _x), y(CELL_SIZE * _y)
+    {
+    }
+
+    void update(Wolfram & next) const {
+        auto neighbors = CASE::CAdjacent<Wolfram>{this};
+        int pattern = 0b000;
+        if (neighbors(-1, -1).live)
+            pattern = pattern | 0b100;
+        if (neighbors(0, -1).live)
+            pattern = pattern | 0b010;
+        if (neighbors(1, -1).live)
+            pattern = pattern | 0b001;
+        if (scanline) {
+            next.scanline = false;
+            next.live = (RULESET >> pattern) & 1;
+        }
+        else if (neighbors(0, -1).scanline)
+            next.scanline = true;
+    }
+
+    void draw(sf::Vertex * vs) const {
+        const auto shade = live ? 0 : 255;
+        CASE::quad(x, y, CELL_SIZE, CELL_SIZE, shade, shade, shade, vs);
+    }
+};
+
+struct Sweep {
+    using Agent = Wolfram;
+    static constexpr int columns = COLUMNS;
+    static constexpr int rows = ROWS;
+    const char* title = "Wolfram sweep";
+    int ruleset = 30;
+    int density = 50;
+
+    void init(Wolfram * agents) {
+        RULESET = ruleset;
+        CASE::Uniform<0, 99> rand;
+        int index = 0;
+        for (auto y = 0; y < ROWS; y++) {
+            for (auto x = 0; x < COLUMNS; x++) {
+                auto & agent = agents[CASE::index(x, y, COLUMNS)];
+                agent = Wolfram{x, y};
+                agent.index = index++;
+                agent.scanline = y == 1;
+                agent.live = y == 0 && rand() < density;
+            }
+        }
+    }
+
+    void postprocessing(Wolfram *) {}
+
+    // fraction of live cells
+    double summary(const Wolfram * agents) const {
+        auto live = 0;
+        for (auto i = 0; i < columns * rows; i++)
+            live += agents[i].live;
+        return double(live) / (columns * rows);
+    }
+};
+
+int main() {
+    std::vector<Sweep> configs;
+    for (const auto ruleset : {30, 45, 73, 90, 105, 110, 150, 184}) {
+        for (auto density = 10; density <= 90; density += 20) {
+            for (auto repeat = 0; repeat < 4; repeat++) {
+                configs.emplace_back();
+                configs.back().ruleset = ruleset;
+                configs.back().density = density;
+            }
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto results = CASE::Ensemble(configs, GENERATIONS);
+    const std::chrono::duration<double> seconds =
+        std::chrono::steady_clock::now() - start;
+    CASE::ensemble_report(std::cout, configs.front().title, results,
+                          seconds.count());
+}
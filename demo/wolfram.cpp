@@ -5,8 +5,12 @@
 #include <CASE/static_sim.hpp>
 #include <CASE/random.hpp>
 
+#ifndef COLUMNS
 #define COLUMNS 300
+#endif
+#ifndef ROWS
 #define ROWS 300
+#endif
 #define CELL_SIZE 2
 
 int RULESET = 0;
@@ -71,22 +75,7 @@ struct Wolframs_Rules {
     const sf::Color bgcolor = sf::Color{220, 220, 220};
 
     void init(Wolfram * agents) {
-        int index = 0;
-        for (auto y = 0; y < ROWS; y++) {
-            for (auto x = 0; x < COLUMNS; x++) {
-                auto & agent = agents[CASE::index(x, y, COLUMNS)];
-                agent = Wolfram{x, y};
-                agent.index = index++;
-            }
-        }
-        for (auto x = 0; x < COLUMNS; x++) {
-            auto & agent = agents[CASE::index(x, 1, COLUMNS)];
-            agent.scanline = true;
-        }
-        const auto x = COLUMNS / 2;
-        const auto y = 0;
-        auto & agent = agents[CASE::index(x, y, COLUMNS)];
-        agent.live = true;
+        init(agents, 0, ROWS);
         /*
         static CASE::Uniform<0, 10> rand;
         int index = 0;
@@ -110,7 +99,24 @@ struct Wolframs_Rules {
         */
     };
 
+    // rows first .. first + count - 1 of the world, which may wrap, so that
+    // distributed runs only set up their own band
+    void init(Wolfram * agents, const int first, const int count) {
+        int index = 0;
+        for (auto k = 0; k < count; k++) {
+            const auto y = CASE::wrap(first + k, ROWS);
+            for (auto x = 0; x < COLUMNS; x++) {
+                auto & agent = agents[CASE::index(x, k, COLUMNS)];
+                agent = Wolfram{x, y};
+                agent.index = index++;
+                agent.scanline = y == 1;
+                agent.live = y == 0 && x == COLUMNS / 2;
+            }
+        }
+    }
+
     void postprocessing(Wolfram * agents) {
+#ifndef CASE_HEADLESS
         static bool pressed = false;
         if(sf::Keyboard::isKeyPressed(sf::Keyboard::PageDown)) {
             if (!pressed) {
@@ -120,7 +126,11 @@ struct Wolframs_Rules {
             }
         }
         else pressed = false;
+#endif
     }
+
+    // distributed runs are headless, there are no keys to poll
+    void postprocessing(Wolfram *, int, int) {}
 };
 
 int main() {
@@ -0,0 +1,220 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_DISTRIBUTED_SIM
+#define CASE_DISTRIBUTED_SIM
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <list>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "static_sim.hpp"
+#include "transport.hpp"
+
+namespace CASE {
+
+// true if the config can initialize a band of rows on its own, with
+//   void init(Agent * band, int first_row, int rows);
+// which fills the global rows first_row .. first_row + rows - 1, wrapping
+// outside [0, Config::rows), into band[(y - first_row) * columns + x]
+template <class Config, class Agent, class = void>
+struct has_band_init : std::false_type {};
+
+template <class Config, class Agent>
+struct has_band_init<Config, Agent, decltype(void(std::declval<Config &>()
+    .init(std::declval<Agent *>(), 0, 0)))> : std::true_type {};
+
+// true if the config has the postprocessing Distributed() needs,
+//   void postprocessing(Agent * band, int first_row, int rows);
+// which sees only the rows of its own process, band[0] being cell
+// (0, first_row), unlike the whole world that Static() passes
+template <class Config, class Agent, class = void>
+struct has_band_postprocessing : std::false_type {};
+
+template <class Config, class Agent>
+struct has_band_postprocessing<Config, Agent, decltype(void(
+    std::declval<Config &>().postprocessing(std::declval<Agent *>(), 0, 0)))>
+    : std::true_type {};
+
+namespace _impl {
+// the band and its halo rows, from the config's band init
+template <class Config, class Agent, class Index>
+void init_band(Config & config, Agent * band, const int first_row,
+               const int rows, const Index row, std::true_type)
+{
+    config.init(band, first_row - 1, rows + 2);
+    for (Index i = 0; i < row * (rows + 2); i++)
+        band[i].index = i;
+}
+
+// every process initializes the whole world and keeps its band, so that
+// the world is the same whatever the number of processes, e.g. when init
+// draws random numbers in order
+template <class Config, class Agent, class Index>
+void init_band(Config & config, Agent * band, const int first_row,
+               const int rows, const Index row, std::false_type)
+{
+    const Index total = row * config.rows;
+    auto whole = allocate<Agent>(total, "init");
+    config.init(whole);
+    for (auto y = -1; y <= rows; y++) {
+        const auto source = wrap(first_row + y, config.rows);
+        for (Index x = 0; x < row; x++) {
+            const auto i = index(x, y + 1, row);
+            band[i] = whole[index(x, source, row)];
+            band[i].index = i;
+        }
+    }
+    deallocate(whole, total);
+}
+} // _impl
+
+// Static() split over $CASE_PROCESSES processes (default 2), or the MPI
+// ranks with CASE_MPI. Each process owns a band of whole rows, stored with
+// a halo row above and below it so that CAdjacent wraps the columns as
+// usual and finds the neighbouring bands in the halos. Every generation the
+// halos are exchanged while the workers update the rows that do not need
+// them, then the two rows next to the halos are updated.
+//
+// A config with the band init above keeps only its band and halos in
+// memory. Without it every process also holds the whole world while it
+// initializes. postprocessing is given the band, see
+// has_band_postprocessing.
+//
+// Runs headless for $CASE_GENERATIONS generations. Process 0 prints the
+// result with a checksum of the final world, which matches the checksum of
+// a CASE_HEADLESS Static() run of the same config.
+template <class Config>
+void Distributed() {
+    Config config;
+    using Agent = typename Config::Agent;
+    using Index = typename index_type<Agent>::type;
+    assert(std::is_trivially_copyable<Agent>::value == true);
+    static_assert(stencil_radius<Agent>::value == 1,
+                  "Distributed() exchanges a halo of one row.");
+    static_assert(has_band_postprocessing<Config, Agent>::value,
+                  "Distributed() needs postprocessing(Agent *, int, int).");
+
+    const auto transport = make_transport(
+        static_cast<int>(env_int("CASE_PROCESSES", 2)));
+    const int rank = transport->rank();
+    const int processes = transport->size();
+    name_thread("main", rank);
+
+    const int columns = config.columns;
+    const int first_row = static_cast<long long>(config.rows) * rank / processes;
+    const int rows = static_cast<long long>(config.rows) * (rank + 1) / processes
+                   - first_row;
+    if (rows < 2) {
+        std::fprintf(stderr, "%d rows over %d processes leaves fewer than 2 "
+                     "rows per process\n", config.rows, processes);
+        std::exit(1);
+    }
+
+    const Index row = columns;
+    const Index size = row * (rows + 2);
+    auto world = Pair<Agent *>{allocate<Agent>(size, "current"),
+                               allocate<Agent>(size, "next")};
+
+    CAdjacent<Agent>::columns = columns;
+    CAdjacent<Agent>::rows = rows + 2;
+
+    // created before init, like in Static(), since with CASE_DETERMINISTIC
+    // each random generator takes the next seed
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+
+    std::list<UpdateJob<Agent, Index>> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    _impl::init_band(config, world.current(), first_row, rows, row,
+                     has_band_init<Config, Agent>{});
+
+    const auto up = (rank + processes - 1) % processes;
+    const auto down = (rank + 1) % processes;
+    const auto bytes = sizeof(Agent) * row;
+
+    auto step = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(row * rows, "cell");
+        const auto current = world.current();
+        const auto next = world.next();
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(current + row, first_row, rows);
+        }
+        for (auto & job : update_jobs) {
+            job.upload(current, next, 2 * row, rows * row);
+            job.launch();
+        }
+        {
+            PhaseScope scope{Phase::Exchange};
+            transport->exchange(
+                {{up, current + row, bytes}, {down, current + rows * row, bytes}},
+                {{down, current + (rows + 1) * row, bytes}, {up, current, bytes}});
+        }
+        {
+            PhaseScope scope{Phase::Update};
+            update_cells(current, next, row, 2 * row);
+            update_cells(current, next, rows * row, (rows + 1) * row);
+        }
+        {
+            PhaseScope scope{Phase::Barrier};
+            for (auto & job : update_jobs)
+                job.wait();
+        }
+        PhaseScope scope{Phase::Flip};
+        world.flip();
+        return row * config.rows;
+    };
+
+    // sum of the per process sums, on process 0
+    auto checksum = [&]() {
+        std::uint64_t sum = 0;
+        for (auto i = row; i < (rows + 1) * row; i++)
+            sum += draw_hash(world.current()[i]);
+
+        std::vector<std::uint64_t> partial(processes, 0);
+        std::vector<Message> out, in;
+        if (rank == 0) {
+            for (auto r = 1; r < processes; r++)
+                in.push_back({r, &partial[r], sizeof sum});
+        }
+        else
+            out.push_back({0, &sum, sizeof sum});
+        transport->exchange(out, in);
+        for (const auto p : partial)
+            sum += p;
+        return sum;
+    };
+
+    Headless run{config.title, "distributed", "cell", config.columns,
+                 config.rows, threads};
+    run.processes = processes;
+    run.report = rank == 0;
+    headless(run, step, [&]() {}, checksum);
+
+    for (auto & job : update_jobs)
+        job.terminate();
+
+    deallocate(world.current(), size);
+    deallocate(world.next(), size);
+    if (rank == 0) {
+        profile_report();
+        trace_write();
+    }
+}
+
+} // CASE
+
+#endif // CASE_DISTRIBUTED_SIM
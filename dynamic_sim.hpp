@@ -5,39 +5,147 @@
 #define CASE_SIM
 
 #include <iostream>
+#include <list>
+#include <thread>
+#include <type_traits>
+#include <vector>
 #include <SFML/Graphics.hpp>
 
 #include "grid.hpp"
+#include "fields.hpp"
+#include "job.hpp"
+#include "quad.hpp"
 #include "agent_manager.hpp"
 #include "timer.hpp"
 #include "log.hpp"
 #include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
 
 namespace CASE {
 
+// Config::Grid if the config declares one, e.g. a ChunkedGrid for an
+// unbounded plane, otherwise Grid<Config::Cell>
+template <class Config, class = void>
+struct grid_type {
+    using type = Grid<typename Config::Cell>;
+};
+
+template <class Config>
+struct grid_type<Config, decltype(void(sizeof(typename Config::Grid)))> {
+    using type = typename Config::Grid;
+};
+
+// true if the config has sf::Color background(const Cell &) const, drawn
+// under the agents of every cell, e.g. to show its fields
+template <class Config, class = void>
+struct has_background : std::false_type {};
+
+template <class Config>
+struct has_background<Config, decltype(void(std::declval<const Config &>()
+    .background(std::declval<const typename Config::Cell &>())))>
+    : std::true_type {};
+
+// Cell::Manager if the cell names one, e.g. the AgentPool of an
+// AtomicZCell, otherwise AgentManager
+template <class Cell, class = void>
+struct manager_type {
+    using type = AgentManager<typename Cell::Agent, typename Cell::Index>;
+};
+
+template <class Cell>
+struct manager_type<Cell, decltype(void(sizeof(typename Cell::Manager)))> {
+    using type = typename Cell::Manager;
+};
+
+// true if the config declares sort_interval, see Dynamic()
+template <class Config, class = void>
+struct has_sort_interval : std::false_type {};
+
+template <class Config>
+struct has_sort_interval<Config, decltype(void(
+    std::declval<const Config &>().sort_interval))> : std::true_type {};
+
+namespace _impl {
+template <class Config>
+long sort_interval(const Config & config, std::true_type) {
+    return config.sort_interval;
+}
+
+template <class Config>
+long sort_interval(const Config &, std::false_type) {
+    return 0;
+}
+
+// steps the fields of the grid by Config::fields, one FieldRule each, on
+// the workers
+template <class Config, class World>
+void step_fields(const Config &, World &, std::list<FieldsJob> &,
+                 std::false_type) {}
+
+template <class Config, class World>
+void step_fields(const Config & config, World & grid,
+                 std::list<FieldsJob> & jobs, std::true_type)
+{
+    for (auto & job : jobs) {
+        job.upload(grid.fields, config.fields);
+        job.launch();
+    }
+    for (auto & job : jobs)
+        job.wait();
+    grid.fields.flip();
+}
+
+template <class Config, class World>
+void draw_background(const Config &, const World &, std::vector<sf::Vertex> &,
+                     std::false_type) {}
+
+template <class Config, class World>
+void draw_background(const Config & config, const World & grid,
+                     std::vector<sf::Vertex> & vertices, std::true_type)
+{
+    const auto size = config.cell_size;
+    for (decltype(grid.cell_count()) i = 0; i < grid.cell_count(); i++) {
+        const auto & cell = grid.cells[i];
+        const auto color = config.background(cell);
+        const auto v = vertices.size();
+        vertices.resize(v + 4);
+        quad(cell.x * size, cell.y * size, size, size, int(color.r),
+             int(color.g), int(color.b), &vertices[v]);
+    }
+}
+} // _impl
+
 template<class Config>
 void Dynamic() {
     Config config;
+    name_thread("main");
 
     using Agent = typename Config::Agent;
     assert(std::is_trivially_copyable<Agent>::value == true);
     using Cell = typename Config::Cell;
+    using Index = typename Cell::Index;
+    using World = typename grid_type<Config>::type;
 
-    auto framerate = config.framerate;
-
+#ifndef CASE_HEADLESS
     sf::RenderWindow window;
     const auto win_w = config.columns * config.cell_size;
     const auto win_h = config.rows * config.cell_size;
     window.create(sf::VideoMode(win_w, win_h), config.title);
     window.setKeyRepeatEnabled(false);
     window.setVerticalSyncEnabled(true);
+#endif
 
     Neighbors<Cell>::columns = config.columns;
     Neighbors<Cell>::rows = config.rows;
 
-    AgentManager<Agent> manager{config.columns * config.rows * Cell::depth};
-    Grid<Cell> grid{config.columns, config.rows, manager};
-    std::vector<sf::Vertex> vertices;
+    // a chunked grid can hold more cells than this, but agents are still
+    // bounded by the view area times the depth
+    using Manager = typename manager_type<Cell>::type;
+    Manager manager{
+        static_cast<Index>(config.columns) * config.rows * Cell::depth};
+    World grid{config.columns, config.rows, manager};
 
     auto reset = [&config, &grid, &manager]()
     {
@@ -45,12 +153,74 @@ void Dynamic() {
     };
     reset();
 
+    // Cells with fields get them stepped by the workers after the agents,
+    // so that an agent sees the fields as the last step left them.
+    static constexpr auto field_layers = field_count<Cell>::value;
+    using has_fields = std::integral_constant<bool, (field_layers > 0)>;
+    std::list<FieldsJob> field_jobs;
+    // workers are started for fields, and by managers other than the serial one
+    const auto serial = field_layers == 0
+        && std::is_same<Manager, AgentManager<Agent, Index>>::value;
+    const int threads = serial ? 1 : worker_count();
+    if (field_layers > 0) {
+        const auto cpus = affinity_layout();
+        for (auto i = 0; i < threads; i++) {
+            field_jobs.emplace_back(i, threads);
+            auto & job = field_jobs.back();
+            job.thread = std::thread{[&job]{ job.run(); }};
+            if (cpus.empty() == false)
+                pin_thread(job.thread, cpus[i % cpus.size()]);
+        }
+    }
+
+    // With $CASE_SORT_INTERVAL or Config::sort_interval above 0, the agents
+    // are sorted into the Z-order of their cells every that many
+    // generations, see AgentManager::sort().
+    const auto sort_interval = env_int("CASE_SORT_INTERVAL",
+        _impl::sort_interval(config, has_sort_interval<Config>{}));
+    long generations = 0;
+
+    auto tick = [&]() {
+        manager.update();
+        grid.collect();
+        _impl::step_fields(config, grid, field_jobs, has_fields{});
+        if (sort_interval > 0 && ++generations % sort_interval == 0)
+            manager.sort();
+    };
+
+#ifdef CASE_NUMA
+    // agents are updated serially by this thread, which also first-touched
+    // them in AgentManager::clear(), so they are already local to it
+    numa_report(std::cerr, "agents", manager.data(),
+                sizeof(Agent) * manager.capacity());
+#endif
+
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(manager.popcount(), "agent");
+        {
+            PhaseScope scope{Phase::Update};
+            tick();
+        }
+        PhaseScope scope{Phase::Postprocessing};
+        config.postprocessing(grid);
+    };
+
+#ifdef CASE_HEADLESS
+    headless({config.title, "dynamic", "agent", config.columns, config.rows,
+              threads},
+             [&]() { const auto n = manager.popcount(); update(); return n; },
+             [&]() {});
+#else
+    auto framerate = config.framerate;
+    std::vector<sf::Vertex> vertices;
+
     auto fast_forward = [&](const auto factor) {
         auto frames = std::pow(10, factor);
         std::cout << "Forwarding " << frames << " frames" << std::endl;
         static Timer timer; timer.start();
         while (frames--)
-            manager.update();
+            tick();
         std::cout << timer.reset() << "ms\n";
     };
 
@@ -65,10 +235,8 @@ void Dynamic() {
         eventhandling(window, running, pause, step, framerate,
                       reset, fast_forward);
         if (pause) {
-            if (step) {
-                manager.update();
-                config.postprocessing(grid);
-            }
+            if (step)
+                update();
             timer.reset();
             dt = 0.0;
         }
@@ -78,20 +246,35 @@ void Dynamic() {
             if (dt > frame_time) {
                 dt -= frame_time;
 
-                manager.update();
-                config.postprocessing(grid);
+                update();
             }
         }
 
-        window.clear(config.bgcolor);
-        vertices.clear();
-
-        for (auto i = 0; i < grid.cell_count(); i++)
-            grid.cells[i].draw(vertices);
+        {
+            PhaseScope scope{Phase::Vertices};
+            vertices.clear();
+            _impl::draw_background(config, grid, vertices,
+                                   has_background<Config>{});
+            grid.draw(vertices);
+        }
 
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
         window.draw(vertices.data(), vertices.size(), sf::Quads);
         window.display();
     }
+#endif
+    for (auto & job : field_jobs)
+        job.terminate();
+    const auto & locality = manager.sort_locality();
+    if (locality.sorts > 0) {
+        std::cerr << "sorted agents " << locality.sorts << " times, cells "
+                  << "between consecutive agents "
+                  << locality.before / locality.sorts << " -> "
+                  << locality.after / locality.sorts << std::endl;
+    }
+    profile_report();
+    trace_write();
 }
 
 } // CASE
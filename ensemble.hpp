@@ -0,0 +1,192 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_ENSEMBLE
+#define CASE_ENSEMBLE
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "index.hpp"
+#include "job.hpp"
+#include "neighbors.hpp"
+#include "random.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "profile.hpp"
+#include "stencil.hpp"
+
+namespace CASE {
+
+struct EnsembleResult {
+    int run = 0;
+    std::uint64_t seed = 0;
+    long generations = 0;
+    double seconds = 0.0;
+    std::uint64_t units = 0;
+    std::uint64_t checksum = 0;
+    double summary = 0.0;
+};
+
+namespace _impl {
+template <class Config, class Agent, class = void>
+struct has_summary : std::false_type {};
+
+template <class Config, class Agent>
+struct has_summary<Config, Agent, decltype(void(
+    std::declval<const Config &>().summary(std::declval<const Agent *>())))>
+    : std::true_type {};
+
+template <class Config, class Agent>
+double summary(const Config & config, const Agent * agents, std::true_type) {
+    return config.summary(agents);
+}
+
+template <class Config, class Agent>
+double summary(const Config &, const Agent *, std::false_type) {
+    return 0.0;
+}
+
+// Calls work(i) for i in [0, count) on $CASE_THREADS threads, or one per
+// core, including the calling thread. Work is handed out one item at a
+// time, so long and short items balance.
+template <class Work>
+void run_pool(const int count, Work work) {
+    const auto env = std::getenv("CASE_THREADS");
+    const int threads = std::min(count,
+        env != nullptr && std::atoi(env) > 0
+            ? std::atoi(env)
+            : std::max<int>(std::thread::hardware_concurrency(), 1));
+    const auto cpus = affinity_layout();
+
+    std::atomic<int> next{0};
+    auto worker = [&](const int nth) {
+        name_thread("ensemble", nth);
+        for (auto i = next++; i < count; i = next++) {
+            TraceScope scope{"ensemble", "run", i};
+            work(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (auto i = 1; i < threads; i++) {
+        pool.emplace_back(worker, i);
+        if (cpus.empty() == false)
+            pin_thread(pool.back(), cpus[i % cpus.size()]);
+    }
+    worker(0);
+    for (auto & thread : pool)
+        thread.join();
+}
+
+template <class Config>
+void check_sizes(const std::vector<Config> & configs) {
+    for (const auto & config : configs) {
+        assert(config.columns == configs.front().columns);
+        assert(config.rows == configs.front().rows);
+        (void)config;
+    }
+}
+} // _impl
+
+// Runs every config in configs for generations generations, many worlds at
+// a time on one pool of threads, $CASE_THREADS or one per core. A world is
+// created, updated and summarized by a single thread, so a small one stays
+// in that core's cache, and total throughput grows with the number of
+// cores rather than every run competing for all of them.
+//
+// The configs are those of Static(), all of the same size since CAdjacent
+// has one size per agent type. Run i is seeded with seed + i: every
+// random generator constructed on its thread while it runs, e.g. in
+// init(), draws its seed from that. Parameters that a rule reads from
+// globals should be thread_local and set in init(). If the config has
+//   double summary(const Agent *) const;
+// its value for the final world is kept in the result.
+template <class Config>
+std::vector<EnsembleResult> Ensemble(std::vector<Config> & configs,
+                                     const long generations,
+                                     const std::uint64_t seed = 1)
+{
+    using Agent = typename Config::Agent;
+    using Index = typename index_type<Agent>::type;
+    assert(std::is_trivially_copyable<Agent>::value == true);
+
+    std::vector<EnsembleResult> results(configs.size());
+    if (configs.empty())
+        return results;
+    _impl::check_sizes(configs);
+    CAdjacent<Agent>::columns = configs.front().columns;
+    CAdjacent<Agent>::rows = configs.front().rows;
+
+    auto simulate = [&](const int i) {
+        using namespace std::chrono;
+        auto & config = configs[i];
+        auto & result = results[i];
+        result.run = i;
+        result.seed = seed + i;
+        result.generations = generations;
+
+        _impl::seed_stream().start(result.seed);
+        const Index size = static_cast<Index>(config.columns) * config.rows;
+        std::vector<Agent> current(size), next(size);
+        config.init(current.data());
+
+        const auto start = steady_clock::now();
+        for (auto g = 0; g < generations; g++) {
+            config.postprocessing(current.data());
+            update_cells(current.data(), next.data(), Index(0), size);
+            std::swap(current, next);
+        }
+        result.seconds = duration<double>(steady_clock::now() - start).count();
+        result.units = static_cast<std::uint64_t>(size) * generations;
+        for (Index a = 0; a < size; a++)
+            result.checksum += draw_hash(current[a]);
+        result.summary = _impl::summary(config, current.data(),
+            _impl::has_summary<Config, Agent>{});
+        _impl::seed_stream().stop();
+    };
+
+    _impl::run_pool(static_cast<int>(configs.size()), simulate);
+    return results;
+}
+
+// One line of JSON per run, then one for the whole ensemble.
+inline void ensemble_report(std::ostream & out, const char * title,
+                            const std::vector<EnsembleResult> & results,
+                            const double seconds)
+{
+    char line[320];
+    std::uint64_t units = 0;
+    for (const auto & r : results) {
+        units += r.units;
+        std::snprintf(line, sizeof line,
+            "{\"rule\":\"%s\",\"run\":%d,\"seed\":%llu,\"generations\":%ld,"
+            "\"seconds\":%.6f,\"per_second\":%.1f,\"summary\":%g,"
+            "\"checksum\":\"%016llx\"}\n", title, r.run,
+            static_cast<unsigned long long>(r.seed), r.generations, r.seconds,
+            r.seconds > 0 ? r.units / r.seconds : 0.0, r.summary,
+            static_cast<unsigned long long>(r.checksum));
+        out << line;
+    }
+    std::snprintf(line, sizeof line,
+        "{\"rule\":\"%s\",\"engine\":\"ensemble\",\"runs\":%zu,"
+        "\"seconds\":%.6f,\"unit\":\"cell\",\"units\":%llu,"
+        "\"per_second\":%.1f,\"peak_rss_kb\":%ld}\n", title, results.size(),
+        seconds, static_cast<unsigned long long>(units),
+        seconds > 0 ? units / seconds : 0.0, peak_rss_kb());
+    out << line;
+}
+
+} // CASE
+
+#endif // CASE_ENSEMBLE
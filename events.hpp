@@ -7,6 +7,8 @@
 #include <functional>
 #include <SFML/Graphics.hpp>
 
+#include "profile.hpp"
+
 namespace CASE {
 
 inline 
@@ -87,6 +89,10 @@ void eventhandling(sf::RenderWindow & window, bool & running, bool & pause,
                     fast_forward(6);
                     continue;
 
+                case sf::Keyboard::P:
+                    profile_report();
+                    continue;
+
                 default:
                     continue;
             }
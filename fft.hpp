@@ -0,0 +1,83 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_FFT
+#define CASE_FFT
+
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <utility>
+#include <vector>
+
+namespace CASE {
+
+inline bool power_of_two(const long n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+// A radix 2 transform of n complex numbers, n a power of two, with the bit
+// reversal and twiddle factors computed once for all transforms of that
+// size. inverse() leaves out the division by n.
+class FFT {
+    using Complex = std::complex<float>;
+
+    int n = 1;
+    std::vector<int> reversed;
+    std::vector<float> cosines, sines;  // of -2 pi k / n, for k < n / 2
+
+    template <bool INVERSE>
+    void transform(Complex * data) const {
+        for (auto i = 0; i < n; i++) {
+            if (i < reversed[i])
+                std::swap(data[i], data[reversed[i]]);
+        }
+        // complex products written out, std::complex checks for NaNs
+        const auto values = reinterpret_cast<float *>(data);
+        for (auto half = 1, step = n / 2; half < n; half *= 2, step /= 2) {
+            for (auto i = 0; i < n; i += 2 * half) {
+                for (auto k = 0; k < half; k++) {
+                    const auto wr = cosines[k * step];
+                    const auto wi = INVERSE ? -sines[k * step] : sines[k * step];
+                    const auto a = 2 * (i + k), b = 2 * (i + k + half);
+                    const auto vr = values[b] * wr - values[b + 1] * wi;
+                    const auto vi = values[b] * wi + values[b + 1] * wr;
+                    values[b] = values[a] - vr;
+                    values[b + 1] = values[a + 1] - vi;
+                    values[a] += vr;
+                    values[a + 1] += vi;
+                }
+            }
+        }
+    }
+
+public:
+    FFT() : reversed(1, 0) {}
+
+    explicit FFT(const int size) : n(size), reversed(size) {
+        assert(power_of_two(size));
+        auto bits = 0;
+        while ((1 << bits) < n)
+            bits++;
+        for (auto i = 0; i < n; i++) {
+            auto r = 0;
+            for (auto b = 0; b < bits; b++)
+                r |= (i >> b & 1) << (bits - 1 - b);
+            reversed[i] = r;
+        }
+        const auto pi = std::acos(-1.0);
+        for (auto k = 0; k < n / 2; k++) {
+            cosines.push_back(static_cast<float>(std::cos(-2 * pi * k / n)));
+            sines.push_back(static_cast<float>(std::sin(-2 * pi * k / n)));
+        }
+    }
+
+    int size() const { return n; }
+
+    void forward(Complex * data) const { transform<false>(data); }
+    void inverse(Complex * data) const { transform<true>(data); }
+};
+
+} // CASE
+
+#endif // CASE_FFT
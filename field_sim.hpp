@@ -0,0 +1,555 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_FIELD_SIM
+#define CASE_FIELD_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "job.hpp"
+#include "helper.hpp"
+#include "quad.hpp"
+#include "timer.hpp"
+#include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "fft.hpp"
+
+namespace CASE {
+
+// A kernel of a continuous automaton. The potential of a cell is the sum of
+// the states of channel source around it, (dx, dy) away weighing
+// weights[(dy + radius) * (2 * radius + 1) + dx + radius], and weight times
+// its growth is added to the cell's channel target.
+struct Kernel {
+    int radius = 1;
+    std::vector<float> weights;
+    int source = 0;
+    int target = 0;
+    float weight = 1;
+};
+
+// Lenia's kernel of concentric shells, each as high as its peak and shaped
+// as exp(4 - 1 / (r (1 - r))) across, normalized to sum to 1.
+inline Kernel lenia_kernel(const int radius, const std::vector<float> & peaks = {1},
+                           const int source = 0, const int target = 0)
+{
+    assert(radius >= 1 && peaks.empty() == false);
+    Kernel kernel;
+    kernel.radius = radius;
+    kernel.source = source;
+    kernel.target = target;
+    const auto side = 2 * radius + 1;
+    const auto shells = static_cast<int>(peaks.size());
+    double total = 0;
+    for (auto dy = -radius; dy <= radius; dy++) {
+        for (auto dx = -radius; dx <= radius; dx++) {
+            const auto r = std::sqrt(double(dx * dx + dy * dy)) / radius * shells;
+            double value = 0;
+            if (r < shells) {
+                const auto x = r - std::floor(r);
+                if (x > 0)
+                    value = peaks[int(r)] * std::exp(4 - 1 / (x * (1 - x)));
+            }
+            kernel.weights.push_back(static_cast<float>(value));
+            total += value;
+        }
+    }
+    assert(static_cast<int>(kernel.weights.size()) == side * side);
+    for (auto & w : kernel.weights)
+        w = static_cast<float>(w / total);
+    return kernel;
+}
+
+// Lenia's growth, 1 at a potential of mu falling off to -1 with sigma
+struct LeniaGrowth {
+    float mu = 0.15f;
+    float sigma = 0.015f;
+
+    float operator()(const float potential) const {
+        const auto d = (potential - mu) / sigma;
+        return 2 * std::exp(-d * d / 2) - 1;
+    }
+};
+
+// Channels of float states on a torus, each a separate array, and the
+// kernels convolved with them. Large kernels go through FFTs of the whole
+// world, which needs sides that are powers of two, each kernel's transform
+// computed once; small ones, or any on other sizes, are summed directly.
+class FieldWorld {
+    using Complex = std::complex<float>;
+
+    int columns = 0;
+    int rows = 0;
+    std::vector<std::vector<float>> fields;     // by channel
+    std::vector<Kernel> kernels;
+    std::vector<std::vector<float>> potentials; // by kernel
+    bool fft = false;
+
+    // with fft, the transforms along rows and columns, the spectra of the
+    // channels that kernels read, and each kernel's, scaled by 1 / size
+    FFT across, down;
+    std::vector<std::vector<Complex>> spectra;  // by channel
+    std::vector<std::vector<Complex>> filters;  // by kernel
+    std::vector<std::vector<Complex>> work;     // by kernel
+
+    std::size_t at(const int x, const int y) const {
+        return std::size_t(y) * columns + x;
+    }
+
+    void transform_kernels() {
+        const auto scale = 1.0f / (float(columns) * rows);
+        for (const auto & kernel : kernels) {
+            // placed so that the convolution sums source(x + dx, y + dy)
+            std::vector<Complex> filter(std::size_t(columns) * rows);
+            const auto r = kernel.radius, side = 2 * r + 1;
+            for (auto dy = -r; dy <= r; dy++) {
+                for (auto dx = -r; dx <= r; dx++) {
+                    filter[at(wrap(-dx, columns), wrap(-dy, rows))]
+                        += kernel.weights[(dy + r) * side + dx + r] * scale;
+                }
+            }
+            for (auto y = 0; y < rows; y++)
+                across.forward(&filter[at(0, y)]);
+            std::vector<Complex> line(rows);
+            for (auto x = 0; x < columns; x++) {
+                for (auto y = 0; y < rows; y++)
+                    line[y] = filter[at(x, y)];
+                down.forward(line.data());
+                for (auto y = 0; y < rows; y++)
+                    filter[at(x, y)] = line[y];
+            }
+            filters.push_back(std::move(filter));
+        }
+    }
+
+public:
+    // With convolution "fft" or "direct" the kernels are convolved that way
+    // if the size allows, otherwise by what is cheaper for the largest.
+    FieldWorld(const int c, const int r, const int channels,
+               const std::vector<Kernel> & k, const char * convolution = "")
+        : columns(c), rows(r), kernels(k)
+    {
+        assert(columns >= 1 && rows >= 1 && channels >= 1);
+        fields.assign(channels, std::vector<float>(std::size_t(c) * r, 0.0f));
+        potentials.assign(kernels.size(), std::vector<float>(std::size_t(c) * r));
+
+        auto largest = 0;
+        for (const auto & kernel : kernels) {
+            assert(kernel.source >= 0 && kernel.source < channels);
+            assert(kernel.target >= 0 && kernel.target < channels);
+            assert(kernel.weights.size()
+                   == std::size_t(2 * kernel.radius + 1) * (2 * kernel.radius + 1));
+            largest = std::max(largest, kernel.radius);
+        }
+        const auto taps = (2 * largest + 1) * (2 * largest + 1);
+        const auto cost = 8 * std::log2(double(columns) * rows);
+        fft = power_of_two(columns) && power_of_two(rows)
+           && std::strcmp(convolution, "direct") != 0
+           && (taps > cost || std::strcmp(convolution, "fft") == 0);
+        if (fft == false)
+            return;
+
+        across = FFT{columns};
+        down = FFT{rows};
+        spectra.resize(channels);
+        for (const auto & kernel : kernels)
+            spectra[kernel.source].resize(std::size_t(c) * r);
+        work.assign(kernels.size(), std::vector<Complex>(std::size_t(c) * r));
+        transform_kernels();
+    }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+    int channels() const { return static_cast<int>(fields.size()); }
+    int kernel_count() const { return static_cast<int>(kernels.size()); }
+    bool uses_fft() const { return fft; }
+
+    float & operator()(const int channel, const int x, const int y) {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        return fields[channel][at(x, y)];
+    }
+
+    float operator()(const int channel, const int x, const int y) const {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        return fields[channel][at(x, y)];
+    }
+
+    void clear() {
+        for (auto & field : fields)
+            std::fill(field.begin(), field.end(), 0.0f);
+    }
+
+    // The passes of a generation, each over rows or columns [first, last)
+    // and done by all workers before the next. With fft they are
+    // forward_rows, forward_columns, inverse_columns and inverse_rows,
+    // otherwise direct, and then grow.
+
+    void forward_rows(const int first, const int last) {
+        for (auto c = 0; c < channels(); c++) {
+            if (spectra[c].empty())
+                continue;
+            for (auto y = first; y < last; y++) {
+                const auto field = &fields[c][at(0, y)];
+                const auto spectrum = &spectra[c][at(0, y)];
+                for (auto x = 0; x < columns; x++)
+                    spectrum[x] = Complex{field[x], 0.0f};
+                across.forward(spectrum);
+            }
+        }
+    }
+
+    void forward_columns(const int first, const int last,
+                         std::vector<Complex> & line)
+    {
+        line.resize(rows);
+        for (auto & spectrum : spectra) {
+            if (spectrum.empty())
+                continue;
+            for (auto x = first; x < last; x++) {
+                for (auto y = 0; y < rows; y++)
+                    line[y] = spectrum[at(x, y)];
+                down.forward(line.data());
+                for (auto y = 0; y < rows; y++)
+                    spectrum[at(x, y)] = line[y];
+            }
+        }
+    }
+
+    void inverse_columns(const int first, const int last,
+                         std::vector<Complex> & line)
+    {
+        line.resize(rows);
+        for (auto k = 0; k < kernel_count(); k++) {
+            const auto & spectrum = spectra[kernels[k].source];
+            const auto & filter = filters[k];
+            for (auto x = first; x < last; x++) {
+                for (auto y = 0; y < rows; y++) {
+                    const auto a = spectrum[at(x, y)], b = filter[at(x, y)];
+                    line[y] = Complex{a.real() * b.real() - a.imag() * b.imag(),
+                                      a.real() * b.imag() + a.imag() * b.real()};
+                }
+                down.inverse(line.data());
+                for (auto y = 0; y < rows; y++)
+                    work[k][at(x, y)] = line[y];
+            }
+        }
+    }
+
+    void inverse_rows(const int first, const int last) {
+        for (auto k = 0; k < kernel_count(); k++) {
+            for (auto y = first; y < last; y++) {
+                const auto row = &work[k][at(0, y)];
+                across.inverse(row);
+                const auto potential = &potentials[k][at(0, y)];
+                for (auto x = 0; x < columns; x++)
+                    potential[x] = row[x].real();
+            }
+        }
+    }
+
+    // each row of a kernel's source is widened by its radius on both sides,
+    // so that every weight is one pass of multiply adds along the row
+    void direct(const int first, const int last, std::vector<float> & line) {
+        for (auto k = 0; k < kernel_count(); k++) {
+            const auto & kernel = kernels[k];
+            const auto r = kernel.radius, side = 2 * r + 1;
+            line.resize(columns + 2 * r);
+            for (auto y = first; y < last; y++) {
+                const auto potential = &potentials[k][at(0, y)];
+                std::fill(potential, potential + columns, 0.0f);
+                for (auto dy = -r; dy <= r; dy++) {
+                    const auto source = &fields[kernel.source][at(0, wrap(y + dy, rows))];
+                    for (auto i = 0; i < columns + 2 * r; i++)
+                        line[i] = source[wrap(i - r, columns)];
+                    for (auto dx = -r; dx <= r; dx++) {
+                        const auto w = kernel.weights[(dy + r) * side + dx + r];
+                        if (w == 0.0f)
+                            continue;
+                        const auto shifted = line.data() + r + dx;
+                        for (auto x = 0; x < columns; x++)
+                            potential[x] += w * shifted[x];
+                    }
+                }
+            }
+        }
+    }
+
+    // Adds dt times the weighted growth of each kernel's potential to its
+    // target and clamps the states to [0, 1]. config.growth(k, potential)
+    // is inlined into the loop over a row, which it should not branch in.
+    template <class Config>
+    void grow(const int first, const int last, const Config & config,
+              std::vector<float> & delta)
+    {
+        delta.resize(std::size_t(channels()) * columns);
+        const float dt = config.dt;
+        for (auto y = first; y < last; y++) {
+            std::fill(delta.begin(), delta.end(), 0.0f);
+            for (auto k = 0; k < kernel_count(); k++) {
+                const auto potential = &potentials[k][at(0, y)];
+                const auto change = &delta[std::size_t(kernels[k].target) * columns];
+                const auto weight = kernels[k].weight;
+                for (auto x = 0; x < columns; x++)
+                    change[x] += weight * config.growth(k, potential[x]);
+            }
+            for (auto c = 0; c < channels(); c++) {
+                const auto field = &fields[c][at(0, y)];
+                const auto change = &delta[std::size_t(c) * columns];
+                for (auto x = 0; x < columns; x++)
+                    field[x] = std::min(std::max(field[x] + dt * change[x], 0.0f),
+                                        1.0f);
+            }
+        }
+    }
+};
+
+template <class Config>
+class FieldJob : public Job {
+    FieldWorld * world = nullptr;
+    const Config * config = nullptr;
+    std::vector<std::complex<float>> line;
+    std::vector<float> scratch;
+
+public:
+    enum class Pass {
+        ForwardRows, ForwardColumns, InverseColumns, InverseRows, Direct, Grow
+    };
+
+private:
+    Pass pass = Pass::Grow;
+
+    // each worker owns one contiguous band of rows, or of columns
+    void execute() override {
+        const auto columns = pass == Pass::ForwardColumns
+                          || pass == Pass::InverseColumns;
+        const long long count = columns ? world->width() : world->height();
+        const auto first = static_cast<int>(count * nth / n_threads);
+        const auto last = static_cast<int>(count * (nth + 1) / n_threads);
+        PhaseScope scope{Phase::Update};
+        switch (pass) {
+            case Pass::ForwardRows: return world->forward_rows(first, last);
+            case Pass::ForwardColumns:
+                return world->forward_columns(first, last, line);
+            case Pass::InverseColumns:
+                return world->inverse_columns(first, last, line);
+            case Pass::InverseRows: return world->inverse_rows(first, last);
+            case Pass::Direct: return world->direct(first, last, scratch);
+            case Pass::Grow:
+                return world->grow(first, last, *config, scratch);
+        }
+    }
+
+    const char * name() const override { return "update"; }
+
+public:
+    using Job::Job;
+
+    void upload(FieldWorld & w, const Config & c, const Pass p) {
+        wait();
+        world = &w;
+        config = &c;
+        pass = p;
+    }
+};
+
+// Runs a continuous automaton, see FieldWorld. The config provides
+//   int columns, rows, cell_size;
+//   double framerate;
+//   const char * title;
+//   sf::Color bgcolor;
+//   int channels;
+//   std::vector<Kernel> kernels;              read once, at the start
+//   float dt;
+//   float growth(int kernel, float potential) const;
+//   void init(FieldWorld &);
+//   void postprocessing(FieldWorld &);        before each generation
+// $CASE_CONVOLUTION=fft or direct overrides the choice of convolution.
+// One channel is drawn dark on the background, up to three as red, green
+// and blue.
+template <class Config>
+void Continuous() {
+    Config config;
+    name_thread("main");
+    using Pass = typename FieldJob<Config>::Pass;
+
+    const auto columns = config.columns;
+    const auto rows = config.rows;
+    const auto size = static_cast<long long>(columns) * rows;
+    const auto convolution = std::getenv("CASE_CONVOLUTION");
+    FieldWorld world{columns, rows, config.channels, config.kernels,
+                     convolution != nullptr ? convolution : ""};
+    std::cerr << "convolution: " << (world.uses_fft() ? "fft" : "direct")
+              << std::endl;
+
+#ifndef CASE_HEADLESS
+    sf::RenderWindow window;
+    window.create(sf::VideoMode(columns * config.cell_size,
+                                rows * config.cell_size), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+#endif
+
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+
+    std::list<FieldJob<Config>> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    auto run = [&](const Pass pass) {
+        for (auto & job : update_jobs) {
+            job.upload(world, config, pass);
+            job.launch();
+        }
+        PhaseScope scope{Phase::Barrier};
+        for (auto & job : update_jobs)
+            job.wait();
+    };
+
+    // the passes each need the last one finished, so a generation is
+    // complete when update returns
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(size, "cell");
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world);
+        }
+        if (world.uses_fft()) {
+            run(Pass::ForwardRows);
+            run(Pass::ForwardColumns);
+            run(Pass::InverseColumns);
+            run(Pass::InverseRows);
+        }
+        else
+            run(Pass::Direct);
+        run(Pass::Grow);
+    };
+
+    auto reset = [&]() {
+        world.clear();
+        config.init(world);
+    };
+
+#ifdef CASE_HEADLESS
+    reset();
+    headless({config.title, "continuous", "cell", columns, rows, threads},
+             [&]() { update(); return size; },
+             [&]() {},
+             [&]() {
+                 // states to 16 bits, so the sum is not at the mercy of
+                 // the last bits of the transforms
+                 std::uint64_t sum = 0;
+                 for (auto c = 0; c < world.channels(); c++) {
+                     for (auto y = 0; y < rows; y++) {
+                         for (auto x = 0; x < columns; x++) {
+                             const auto i = (std::uint64_t(c) * rows + y)
+                                          * columns + x;
+                             sum += state_hash(i, std::lround(
+                                 world(c, x, y) * 65535.0f));
+                         }
+                     }
+                 }
+                 return sum;
+             });
+#else
+    std::vector<sf::Vertex> vertices(size * 4);
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++) {
+            quad(x * config.cell_size, y * config.cell_size, config.cell_size,
+                 config.cell_size, &vertices[(std::size_t(y) * columns + x) * 4]);
+        }
+    }
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double framerate = config.framerate;
+    double dt = 0.0;
+    Timer timer;
+
+    reset();
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+                update();
+            }
+        }
+
+        {
+            PhaseScope scope{Phase::Vertices};
+            const auto bg = config.bgcolor;
+            for (auto y = 0; y < rows; y++) {
+                for (auto x = 0; x < columns; x++) {
+                    const auto vs = &vertices[(std::size_t(y) * columns + x) * 4];
+                    if (world.channels() == 1) {
+                        const auto v = world(0, x, y);
+                        quad(int(bg.r * (1 - v)), int(bg.g * (1 - v)),
+                             int(bg.b * (1 - v)), vs);
+                        continue;
+                    }
+                    int rgb[3] = {0, 0, 0};
+                    for (auto c = 0; c < std::min(world.channels(), 3); c++)
+                        rgb[c] = int(255 * world(c, x, y));
+                    quad(rgb[0], rgb[1], rgb[2], vs);
+                }
+            }
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(&vertices[0], vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+
+    for (auto & job : update_jobs)
+        job.terminate();
+
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_FIELD_SIM
@@ -0,0 +1,145 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_FIELDS
+#define CASE_FIELDS
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "job.hpp"
+#include "profile.hpp"
+
+namespace CASE {
+
+// How a scalar field changes each step, in this order: it diffuses by
+// moving diffusion (0 .. 1) of the way to the mean of the four
+// neighbouring cells, loses decay of itself, grows logistically at rate
+// growth toward capacity, gains source, and is clamped to [0, capacity].
+struct FieldRule {
+    float diffusion = 0;
+    float decay = 0;
+    float growth = 0;
+    float source = 0;
+    float capacity = 1;
+};
+
+// the number of fields of a cell, Cell::fields if it declares them
+template <class Cell, class = void>
+struct field_count : std::integral_constant<int, 0> {};
+
+template <class Cell>
+struct field_count<Cell, decltype(void(Cell::fields))>
+    : std::integral_constant<int, Cell::fields> {};
+
+// Dense scalar fields over the cells of a torus, each a float array
+// indexed like the cells, and a second array each that steps write into.
+class Fields {
+    int columns = 0;
+    int rows = 0;
+    std::vector<std::vector<float>> storage;
+    std::vector<float *> current, next;
+
+    // one cell, given the indices of its neighbours in the row
+    static float advance(const float * up, const float * middle,
+                         const float * down, const int x, const int left,
+                         const int right, const FieldRule & rule)
+    {
+        const auto mean = 0.25f * (up[x] + down[x] + middle[left] + middle[right]);
+        auto v = middle[x] + rule.diffusion * (mean - middle[x]);
+        v -= rule.decay * v;
+        v += rule.growth * v * (1 - v / rule.capacity) + rule.source;
+        return std::min(std::max(v, 0.0f), rule.capacity);
+    }
+
+public:
+    void init(const int count, const int c, const int r) {
+        columns = c;
+        rows = r;
+        storage.assign(2 * count, std::vector<float>(std::size_t(c) * r, 0.0f));
+        current.resize(count);
+        next.resize(count);
+        for (auto f = 0; f < count; f++) {
+            current[f] = storage[2 * f].data();
+            next[f] = storage[2 * f + 1].data();
+        }
+    }
+
+    int count() const { return static_cast<int>(current.size()); }
+    int height() const { return rows; }
+
+    float * operator[](const int f) { return current[f]; }
+    const float * operator[](const int f) const { return current[f]; }
+
+    // the arrays of the current values, which stays valid across flip()
+    float * const * arrays() const { return current.data(); }
+
+    void clear() {
+        for (auto & values : storage)
+            std::fill(values.begin(), values.end(), 0.0f);
+    }
+
+    // steps rows [first, last) of every field by its rule
+    void step(const std::vector<FieldRule> & rules, const int first,
+              const int last)
+    {
+        assert(static_cast<int>(rules.size()) == count());
+        for (auto f = 0; f < count(); f++) {
+            const auto & rule = rules[f];
+            for (auto y = first; y < last; y++) {
+                const auto up = current[f]
+                    + std::size_t(y == 0 ? rows - 1 : y - 1) * columns;
+                const auto middle = current[f] + std::size_t(y) * columns;
+                const auto down = current[f]
+                    + std::size_t(y == rows - 1 ? 0 : y + 1) * columns;
+                const auto out = next[f] + std::size_t(y) * columns;
+                // the ends of the row wrap, the rest vectorizes
+                for (auto x = 1; x < columns - 1; x++)
+                    out[x] = advance(up, middle, down, x, x - 1, x + 1, rule);
+                out[0] = advance(up, middle, down, 0, columns - 1,
+                                 std::min(1, columns - 1), rule);
+                if (columns > 1)
+                    out[columns - 1] = advance(up, middle, down, columns - 1,
+                                               columns - 2, 0, rule);
+            }
+        }
+    }
+
+    // makes the values computed by step() the current ones, swapping the
+    // pointers in place so that arrays() keeps pointing at them
+    void flip() {
+        for (std::size_t f = 0; f < current.size(); f++)
+            std::swap(current[f], next[f]);
+    }
+};
+
+class FieldsJob : public Job {
+    Fields * fields = nullptr;
+    const std::vector<FieldRule> * rules = nullptr;
+
+    // each worker owns one contiguous band of rows
+    void execute() override {
+        const long long rows = fields->height();
+        PhaseScope scope{Phase::Update};
+        fields->step(*rules, static_cast<int>(rows * nth / n_threads),
+                     static_cast<int>(rows * (nth + 1) / n_threads));
+    }
+
+    const char * name() const override { return "fields"; }
+
+public:
+    using Job::Job;
+
+    void upload(Fields & f, const std::vector<FieldRule> & r) {
+        wait();
+        fields = &f;
+        rules = &r;
+    }
+};
+
+} // CASE
+
+#endif // CASE_FIELDS
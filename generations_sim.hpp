@@ -0,0 +1,419 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_GENERATIONS_SIM
+#define CASE_GENERATIONS_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <type_traits>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "job.hpp"
+#include "helper.hpp"
+#include "quad.hpp"
+#include "timer.hpp"
+#include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "rule.hpp"
+
+namespace CASE {
+
+// The cells of a Generations rule on a torus, as bit planes of 64 cells to
+// a word: one plane of the cells that are on, and the count of steps into
+// the refractory states, 0 if not refractory, spread over as many planes as
+// it needs. Rows are padded to whole words, with the padding kept 0.
+class GenerationsWorld {
+public:
+    static constexpr int max_planes = 1 + 8;
+
+private:
+    int columns = 0;
+    int rows = 0;
+    int words = 0;
+    int planes = 1;
+    GenerationsRule compiled;
+    std::vector<std::uint64_t> generation[2];
+    int parity = 0;
+
+    std::uint64_t * row(const int g, const int plane, const int y) {
+        return generation[g].data() + (std::size_t(plane) * rows + y) * words;
+    }
+
+    const std::uint64_t * row(const int g, const int plane, const int y) const {
+        return generation[g].data() + (std::size_t(plane) * rows + y) * words;
+    }
+
+    // the neighbours west and east of word i, wrapping around the row
+    void sides(const std::uint64_t * line, const int i, std::uint64_t & west,
+               std::uint64_t & east) const
+    {
+        const auto last = (columns - 1) & 63;
+        west = line[i] << 1 | (i > 0 ? line[i - 1] >> 63
+                                     : line[words - 1] >> last & 1);
+        east = line[i] >> 1 | (i < words - 1 ? line[i + 1] << 63
+                                             : (line[0] & 1) << last);
+    }
+
+    // the cells whose count, in bits n[0] .. n[3], is in counts
+    static std::uint64_t match(const std::uint64_t * n, const unsigned counts) {
+        std::uint64_t result = 0;
+        for (auto k = 0; k <= 8; k++) {
+            if ((counts >> k & 1) == 0)
+                continue;
+            result |= (k & 1 ? n[0] : ~n[0]) & (k & 2 ? n[1] : ~n[1])
+                    & (k & 4 ? n[2] : ~n[2]) & (k & 8 ? n[3] : ~n[3]);
+        }
+        return result;
+    }
+
+public:
+    GenerationsWorld(const int c, const int r, const GenerationsRule & rule)
+        : columns(c), rows(r), words((c + 63) / 64), compiled(rule)
+    {
+        assert(columns >= 1 && rows >= 1);
+        assert(rule.states >= 2 && rule.states <= 256);
+        // enough planes for the longest refractory count, states - 2
+        for (auto longest = rule.states - 2; longest != 0; longest >>= 1)
+            planes++;
+        for (auto & g : generation)
+            g.assign(std::size_t(planes) * rows * words, 0);
+    }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+    const GenerationsRule & rule() const { return compiled; }
+
+    int operator()(const int x, const int y) const {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        const auto w = x >> 6, b = x & 63;
+        if (row(parity, 0, y)[w] >> b & 1)
+            return 1;
+        auto count = 0;
+        for (auto p = 1; p < planes; p++)
+            count |= int(row(parity, p, y)[w] >> b & 1) << (p - 1);
+        return count == 0 ? 0 : count + 1;
+    }
+
+    void set(const int x, const int y, const int state) {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        assert(state >= 0 && state < compiled.states);
+        const auto w = x >> 6;
+        const auto bit = std::uint64_t{1} << (x & 63);
+        const auto count = state < 2 ? 0 : state - 1;
+        for (auto p = 0; p < planes; p++) {
+            const auto on = p == 0 ? state == 1 : (count >> (p - 1) & 1) != 0;
+            auto & word = row(parity, p, y)[w];
+            word = on ? word | bit : word & ~bit;
+        }
+    }
+
+    void clear() {
+        for (auto & g : generation)
+            std::fill(g.begin(), g.end(), 0);
+    }
+
+    // Computes rows [first, last) of the next generation. The neighbour
+    // counts come from full adders over the shifted words of the on plane.
+    void step(const int first, const int last) {
+        const auto next = parity ^ 1;
+        const auto refractory_planes = planes - 1;
+        const auto wrap_count = compiled.states - 1;
+        // cells past the end of a row stay 0
+        const auto tail = columns % 64 == 0
+            ? ~std::uint64_t{0} : (std::uint64_t{1} << (columns % 64)) - 1;
+
+        for (auto y = first; y < last; y++) {
+            const auto up = row(parity, 0, y == 0 ? rows - 1 : y - 1);
+            const auto middle = row(parity, 0, y);
+            const auto down = row(parity, 0, y == rows - 1 ? 0 : y + 1);
+
+            for (auto i = 0; i < words; i++) {
+                const auto mask = i == words - 1 ? tail : ~std::uint64_t{0};
+                std::uint64_t w, e;
+                // top and bottom rows, three cells each
+                sides(up, i, w, e);
+                const auto t0 = w ^ up[i] ^ e;
+                const auto t1 = (w & up[i]) | (e & (w ^ up[i]));
+                sides(down, i, w, e);
+                const auto b0 = w ^ down[i] ^ e;
+                const auto b1 = (w & down[i]) | (e & (w ^ down[i]));
+                // the middle row without the cell itself
+                sides(middle, i, w, e);
+                const auto m0 = w ^ e;
+                const auto m1 = w & e;
+                // the three partial sums, each 0 .. 3, added up
+                std::uint64_t n[4];
+                n[0] = t0 ^ m0 ^ b0;
+                const auto c1 = (t0 & m0) | (b0 & (t0 ^ m0));
+                const auto s1 = t1 ^ m1 ^ b1;
+                const auto c2 = (t1 & m1) | (b1 & (t1 ^ m1));
+                n[1] = s1 ^ c1;
+                const auto c3 = s1 & c1;
+                n[2] = c2 ^ c3;
+                n[3] = c2 & c3;
+
+                const auto on = middle[i];
+                std::uint64_t count[max_planes - 1];
+                std::uint64_t refractory = 0;
+                for (auto p = 0; p < refractory_planes; p++) {
+                    count[p] = row(parity, p + 1, y)[i];
+                    refractory |= count[p];
+                }
+                const auto survive = match(n, compiled.survive);
+                const auto born = match(n, compiled.born);
+
+                row(next, 0, y)[i] = ((on & survive) | (~on & ~refractory & born))
+                                   & mask;
+                if (refractory_planes == 0)
+                    continue;
+
+                // refractory cells count up until wrap_count, which is dead
+                auto carry = ~std::uint64_t{0};
+                auto done = ~std::uint64_t{0};
+                for (auto p = 0; p < refractory_planes; p++) {
+                    const auto sum = count[p] ^ carry;
+                    carry &= count[p];
+                    count[p] = sum;
+                    done &= wrap_count >> p & 1 ? sum : ~sum;
+                }
+                const auto keep = refractory & ~done;
+                const auto dying = on & ~survive;
+                for (auto p = 0; p < refractory_planes; p++) {
+                    row(next, p + 1, y)[i] = ((count[p] & keep)
+                                             | (p == 0 ? dying : 0)) & mask;
+                }
+            }
+        }
+    }
+
+    // makes the generation computed by step() the current one
+    void flip() { parity ^= 1; }
+};
+
+class GenerationsJob : public Job {
+    GenerationsWorld * world = nullptr;
+
+    // each worker owns one contiguous band of rows
+    void execute() override {
+        const long long rows = world->height();
+        PhaseScope scope{Phase::Update};
+        world->step(static_cast<int>(rows * nth / n_threads),
+                    static_cast<int>(rows * (nth + 1) / n_threads));
+    }
+
+    const char * name() const override { return "update"; }
+
+public:
+    using Job::Job;
+
+    void upload(GenerationsWorld & w) {
+        wait();
+        world = &w;
+    }
+};
+
+namespace _impl {
+template <class Config>
+sf::Color state_color(const Config & config, const int state, const int,
+                      std::true_type)
+{
+    return config.color(state);
+}
+
+// on cells black, refractory ones fading from blue to the background
+template <class Config>
+sf::Color state_color(const Config & config, const int state,
+                      const int states, std::false_type)
+{
+    const auto bg = config.bgcolor;
+    if (state == 0)
+        return bg;
+    if (state == 1)
+        return sf::Color::Black;
+    const auto t = double(state - 2) / std::max(states - 2, 1);
+    const auto mix = [t](const int from, const int to) {
+        return static_cast<std::uint8_t>(from + (to - from) * t);
+    };
+    return sf::Color{mix(100, bg.r), mix(100, bg.g), mix(255, bg.b)};
+}
+} // _impl
+
+// Runs a Generations rule on bit planes, see GenerationsWorld. The config
+// provides
+//   int columns, rows, cell_size;
+//   double framerate;
+//   const char * title;
+//   sf::Color bgcolor;
+//   GenerationsRule rule;                     read once, at the start
+//   void init(GenerationsWorld &);
+//   void postprocessing(GenerationsWorld &);  before each generation
+// and optionally sf::Color color(int state) const for drawing.
+template <class Config>
+void Generations() {
+    Config config;
+    name_thread("main");
+
+    const auto columns = config.columns;
+    const auto rows = config.rows;
+    const auto size = static_cast<long long>(columns) * rows;
+    GenerationsWorld world{columns, rows, config.rule};
+
+#ifndef CASE_HEADLESS
+    sf::RenderWindow window;
+    window.create(sf::VideoMode(columns * config.cell_size,
+                                rows * config.cell_size), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+#endif
+
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+
+    std::list<GenerationsJob> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    // the workers write the next generation while the current one is
+    // drawn, which it becomes at the start of the following update
+    bool pending = false;
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(size, "cell");
+        {
+            PhaseScope scope{Phase::Barrier};
+            for (auto & job : update_jobs)
+                job.wait();
+        }
+        if (pending) {
+            PhaseScope scope{Phase::Flip};
+            world.flip();
+        }
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world);
+        }
+        for (auto & job : update_jobs) {
+            job.upload(world);
+            job.launch();
+        }
+        pending = true;
+    };
+
+    auto reset = [&]() {
+        for (auto & job : update_jobs) job.wait();
+        world.clear();
+        pending = false;
+        config.init(world);
+    };
+
+#ifdef CASE_HEADLESS
+    reset();
+    headless({config.title, "generations", "cell", columns, rows, threads},
+             [&]() { update(); return size; },
+             [&]() { for (auto & job : update_jobs) job.wait(); },
+             [&]() {
+                 if (pending)
+                     world.flip();
+                 pending = false;
+                 std::uint64_t sum = 0;
+                 for (auto y = 0; y < rows; y++) {
+                     for (auto x = 0; x < columns; x++)
+                         sum += state_hash(std::uint64_t(y) * columns + x,
+                                           world(x, y));
+                 }
+                 return sum;
+             });
+#else
+    std::vector<sf::Color> palette;
+    for (auto s = 0; s < world.rule().states; s++)
+        palette.push_back(_impl::state_color(config, s, world.rule().states,
+                                             has_state_color<Config>{}));
+
+    std::vector<sf::Vertex> vertices(size * 4);
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++) {
+            quad(x * config.cell_size, y * config.cell_size, config.cell_size,
+                 config.cell_size, &vertices[(std::size_t(y) * columns + x) * 4]);
+        }
+    }
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double framerate = config.framerate;
+    double dt = 0.0;
+    Timer timer;
+
+    reset();
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+                update();
+            }
+        }
+
+        // the current generation is only read while the workers run
+        {
+            PhaseScope scope{Phase::Vertices};
+            for (auto y = 0; y < rows; y++) {
+                for (auto x = 0; x < columns; x++) {
+                    const auto & c = palette[world(x, y)];
+                    quad(int(c.r), int(c.g), int(c.b),
+                         &vertices[(std::size_t(y) * columns + x) * 4]);
+                }
+            }
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(&vertices[0], vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+
+    for (auto & job : update_jobs)
+        job.terminate();
+
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_GENERATIONS_SIM
@@ -5,50 +5,82 @@
 #define CASE_GRID
 
 #include <cassert>
+#include <memory>
 
 #include "index.hpp"
 #include "agent_manager.hpp"
+#include "memory.hpp"
+#include "neighbors.hpp"
+#include "chunk.hpp"
+#include "fields.hpp"
 
 namespace CASE {
 
-template<class Cell>
+// C and R fix the size at compile time, see CAdjacent, and must
+// then match the size given to init().
+template<class Cell, int C = 0, int R = 0>
 class Grid {
+    static_assert(is_chunked<Cell>::value == false,
+                  "Grid is one array, use ZCell rather than ChunkedZCell.");
     using Agent = typename Cell::Agent;
+    using Index = typename Cell::Index;
 
-    int columns = 0;
-    int rows = 0;
+    int columns = C;
+    int rows = R;
+    AgentManager<Agent, Index> * manager = nullptr;
 
-    inline Cell & get(const int x, const int y) {
-        return cells[index(wrap(x, columns), wrap(y, rows), columns)];
+    void unbind_fields() {
+        if (manager != nullptr && manager->field_arrays == fields.arrays())
+            manager->field_arrays = nullptr;
+        manager = nullptr;
+    }
+
+    inline Cell & get(const int x, const int y) const {
+        const _impl::Extent<C> c{columns};
+        const _impl::Extent<R> r{rows};
+        return cells[index(Index(c.wrap(x)), r.wrap(y), c())];
     }
 
 public:
     Cell * cells = nullptr;
 
+    // the dense scalar fields of the cells, Cell::fields of them
+    Fields fields;
+
     ~Grid() {
-        if (cells != nullptr)
-            delete [] cells;
+        deallocate(cells, cell_count());
         cells = nullptr;
+        unbind_fields();
     }
 
     Grid() {}
 
-    Grid(const int cols, const int _rows, AgentManager<Agent> & manager) {
+    // Manager is an AgentManager, or the Cell::Manager of cells that have one
+    template <class Manager>
+    Grid(const int cols, const int _rows, Manager & manager)
+    {
         init(cols, _rows, manager);
     }
 
-    void init(const int cols, const int _rows, AgentManager<Agent> & manager) {
+    template <class Manager>
+    void init(const int cols, const int _rows, Manager & manager) {
         assert(cols >= 1);
         assert(_rows >= 1);
+        assert(C == 0 || cols == C);
+        assert(R == 0 || _rows == R);
 
+        deallocate(cells, cell_count());
+        unbind_fields();
         columns = cols;
         rows = _rows;
+        cells = allocate<Cell>(cell_count(), "cells");
+        fields.init(field_count<Cell>::value, columns, rows);
+        // the cells read the fields of this grid through their manager,
+        // so that grids of one cell type each have their own
+        this->manager = &manager;
+        manager.field_arrays = fields.arrays();
 
-        if (cells != nullptr)
-            delete [] cells;
-        cells = new Cell[cell_count()];
-
-        int index = 0;
+        Index index = 0;
         for (auto y = 0; y < rows; y++) {
             for (auto x = 0; x < columns; x++) {
                 auto & cell = get(x, y);
@@ -69,12 +101,204 @@ public:
     }
 
     void clear() {
-        for (auto i = 0; i < cell_count(); i++)
+        for (Index i = 0; i < cell_count(); i++)
             cells[i].clear();
+        fields.clear();
+    }
+
+    template <class Vertices>
+    void draw(Vertices & vertices) const {
+        for (Index i = 0; i < cell_count(); i++)
+            cells[i].draw(vertices);
+    }
+
+    // a fixed grid has nothing to release, see ChunkedGrid
+    void collect() {}
+
+    inline Index cell_count() const {
+        return static_cast<Index>(rows) * columns;
+    }
+};
+
+// An unbounded grid of SIZE x SIZE chunks, allocated when an agent first
+// reaches them and freed after they have been empty for a while. Cells keep
+// their global coordinates in x, y and their index within the chunk in
+// index. columns and rows only set the part of the plane that is drawn.
+template <class Cell, int SIZE = 64>
+class ChunkedGrid {
+    static_assert(SIZE > 0 && (SIZE & (SIZE - 1)) == 0,
+                  "ChunkedGrid SIZE must be a power of two.");
+    static_assert(field_count<Cell>::value == 0,
+                  "ChunkedGrid has no fields, use Grid.");
+    static_assert(is_chunked<Cell>::value,
+                  "ChunkedGrid needs cells that find neighbours through it, "
+                  "use ChunkedZCell.");
+    using Agent = typename Cell::Agent;
+    using Index = typename Cell::Index;
+
+    struct Chunk {
+        Cell cells[SIZE * SIZE];
+        int cx = 0, cy = 0;
+        int idle = 0;
+    };
+
+    ChunkMap<Chunk> chunks;
+    AgentManager<Agent, Index> * manager = nullptr;
+    int columns = 0;
+    int rows = 0;
+
+    // what reads of cells in chunks that do not exist see
+    const Cell empty{};
+
+    Chunk * ensure(const int cx, const int cy) {
+        auto chunk = chunks.find(cx, cy);
+        if (chunk != nullptr)
+            return chunk;
+
+        std::unique_ptr<Chunk> fresh{new Chunk};
+        fresh->cx = cx;
+        fresh->cy = cy;
+        for (auto i = 0; i < SIZE * SIZE; i++) {
+            auto & cell = fresh->cells[i];
+            cell.x = cx * SIZE + i % SIZE;
+            cell.y = cy * SIZE + i / SIZE;
+            cell.index = i;
+            cell.set_manager(*manager);
+        }
+        return chunks.insert(cx, cy, std::move(fresh));
+    }
+
+    static int chunk_of(const int v) {
+        return static_cast<int>(floor_div(v, SIZE));
+    }
+
+    static int within(const int v, const int c) {
+        return v - c * SIZE;
+    }
+
+    inline Cell & get(const int x, const int y) {
+        const auto cx = chunk_of(x), cy = chunk_of(y);
+        auto chunk = ensure(cx, cy);
+        return chunk->cells[within(y, cy) * SIZE + within(x, cx)];
+    }
+
+    // neighbours within the chunk are plain pointer arithmetic, only the
+    // cells along its border go through the chunk map
+    static void * locate(void * grid, void * cell, const int x, const int y) {
+        const auto self = static_cast<Cell *>(cell);
+        const auto lx = static_cast<int>(self->index % SIZE) + x;
+        const auto ly = static_cast<int>(self->index / SIZE) + y;
+        if (lx >= 0 && lx < SIZE && ly >= 0 && ly < SIZE)
+            return self + y * SIZE + x;
+        return &static_cast<ChunkedGrid *>(grid)->get(self->x + x, self->y + y);
+    }
+
+public:
+    static constexpr int chunk_size = SIZE;
+
+    ChunkedGrid() {}
+
+    ChunkedGrid(const int cols, const int _rows,
+                AgentManager<Agent, Index> & manager)
+    {
+        init(cols, _rows, manager);
+    }
+
+    ~ChunkedGrid() {
+        if (manager != nullptr && manager->locator.grid == this)
+            manager->locator = Locator{};
+    }
+
+    ChunkedGrid(const ChunkedGrid &) = delete;
+    ChunkedGrid & operator=(const ChunkedGrid &) = delete;
+
+    // the manager is this grid's alone, its cells find their neighbours
+    // through it
+    void init(const int cols, const int _rows,
+              AgentManager<Agent, Index> & _manager)
+    {
+        assert(cols >= 1);
+        assert(_rows >= 1);
+        assert(_manager.locator.grid == nullptr
+               || _manager.locator.grid == this);
+
+        clear();
+        if (manager != nullptr && manager != &_manager)
+            manager->locator = Locator{};
+        columns = cols;
+        rows = _rows;
+        manager = &_manager;
+        manager->locator = Locator{this, &locate};
+    }
+
+    // the cell, allocating its chunk if it has none
+    Cell & operator()(const int x, const int y) {
+        return get(x, y);
+    }
+
+    // the cell, or an empty one if its chunk has not been allocated
+    const Cell & operator()(const int x, const int y) const {
+        const auto cell = find(x, y);
+        return cell == nullptr ? empty : *cell;
+    }
+
+    // the cell if its chunk has been allocated, otherwise null
+    const Cell * find(const int x, const int y) const {
+        const auto cx = chunk_of(x), cy = chunk_of(y);
+        const auto chunk = chunks.find(cx, cy);
+        if (chunk == nullptr)
+            return nullptr;
+        return &chunk->cells[within(y, cy) * SIZE + within(x, cx)];
+    }
+
+    void clear() {
+        for (auto chunk : chunks.list()) {
+            for (auto & cell : chunk->cells)
+                cell.clear();
+        }
+        chunks.clear();
+    }
+
+    // Frees the chunks that have been empty for more than idle_limit calls.
+    // Their cells are cleared first, which deactivates any agent left
+    // pointing into them.
+    void collect(const int idle_limit = 16) {
+        for (auto chunk : chunks.list()) {
+            auto empty = true;
+            for (const auto & cell : chunk->cells) {
+                if (cell.is_occupied()) {
+                    empty = false;
+                    break;
+                }
+            }
+            if (empty == false)
+                chunk->idle = 0;
+            else if (++chunk->idle > idle_limit) {
+                for (auto & cell : chunk->cells)
+                    cell.clear();
+                chunks.erase(chunk->cx, chunk->cy);
+            }
+        }
     }
 
-    inline int cell_count() const {
-        return rows * columns;
+    // draws the cells within [0, columns) x [0, rows)
+    template <class Vertices>
+    void draw(Vertices & vertices) const {
+        for (auto chunk : chunks.list()) {
+            const auto x0 = chunk->cx * SIZE, y0 = chunk->cy * SIZE;
+            if (x0 + SIZE <= 0 || y0 + SIZE <= 0 || x0 >= columns || y0 >= rows)
+                continue;
+            for (const auto & cell : chunk->cells) {
+                if (cell.x < columns && cell.y < rows && cell.x >= 0 && cell.y >= 0)
+                    cell.draw(vertices);
+            }
+        }
+    }
+
+    std::size_t chunk_count() const { return chunks.size(); }
+
+    inline Index cell_count() const {
+        return static_cast<Index>(chunks.size()) * SIZE * SIZE;
     }
 };
 
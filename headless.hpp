@@ -0,0 +1,111 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_HEADLESS_RUN
+#define CASE_HEADLESS_RUN
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+#include <SFML/Graphics.hpp>
+
+namespace CASE {
+
+inline long env_int(const char * name, const long fallback) {
+    const auto value = std::getenv(name);
+    if (value == nullptr || *value == '\0')
+        return fallback;
+    return std::strtol(value, nullptr, 10);
+}
+
+inline long peak_rss_kb() {
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+}
+
+struct Headless {
+    const char * title;
+    const char * engine;    // "static" or "dynamic"
+    const char * unit;      // "cell" or "agent"
+    long columns;
+    long rows;
+    int threads;
+    int processes = 1;
+    bool report = true;     // false on all but one process of a run
+    int block = 1;          // generations per step()
+};
+
+// Order independent hash of one agent as drawn, so that it covers what a
+// rule computes and where, but not padding bytes or local indices. Sums of
+// it over the parts of a world add up to the sum over the whole world.
+template <class Agent>
+std::uint64_t draw_hash(const Agent & agent) {
+    sf::Vertex vertices[4];
+    agent.draw(vertices);
+    std::uint64_t hash = 14695981039346656037ull;
+    const auto bytes = reinterpret_cast<const unsigned char *>(vertices);
+    for (auto i = 0u; i < sizeof vertices; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    hash ^= hash >> 31;
+    hash *= 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 29);
+}
+
+// draw_hash() for engines whose cells are plain states at positions
+inline std::uint64_t state_hash(const std::uint64_t position,
+                                const std::uint64_t state)
+{
+    auto hash = (position * 0x9e3779b97f4a7c15ull) ^ state;
+    hash ^= hash >> 31;
+    hash *= 0xbf58476d1ce4e5b9ull;
+    return hash ^ (hash >> 29);
+}
+
+// Runs $CASE_GENERATIONS (default 100) generations without a window and
+// prints one line of JSON describing the run. step() advances run.block
+// generations, the total being rounded up to whole steps, and returns the
+// number of cells or agents it updated, sync()
+// returns once all launched work has completed and checksum() hashes the
+// final world, 0 if there is nothing to compare.
+template <class Step, class Sync, class Checksum>
+void headless(const Headless & run, Step step, Sync sync, Checksum checksum) {
+    using namespace std::chrono;
+    const auto requested = env_int("CASE_GENERATIONS", 100);
+
+    std::uint64_t units = 0;
+    long generations = 0;
+    const auto start = steady_clock::now();
+    for (; generations < requested; generations += run.block)
+        units += step();
+    sync();
+    const auto seconds = duration<double>(steady_clock::now() - start).count();
+    const std::uint64_t hash = checksum();
+    if (run.report == false)
+        return;
+
+    std::printf("{\"rule\":\"%s\",\"engine\":\"%s\",\"columns\":%ld,"
+                "\"rows\":%ld,\"threads\":%d,\"processes\":%d,"
+                "\"generations\":%ld,\"seconds\":%.6f,\"unit\":\"%s\","
+                "\"units\":%llu,\"per_second\":%.1f,\"peak_rss_kb\":%ld,"
+                "\"checksum\":\"%016llx\"}\n",
+                run.title, run.engine, run.columns, run.rows, run.threads,
+                run.processes, generations, seconds, run.unit,
+                static_cast<unsigned long long>(units),
+                seconds > 0 ? units / seconds : 0.0, peak_rss_kb(),
+                static_cast<unsigned long long>(hash));
+    std::fflush(stdout);
+}
+
+template <class Step, class Sync>
+void headless(const Headless & run, Step step, Sync sync) {
+    headless(run, step, sync, []() { return std::uint64_t{0}; });
+}
+
+} // CASE
+
+#endif // CASE_HEADLESS_RUN
@@ -4,18 +4,52 @@
 #ifndef CASE_HELPER
 #define CASE_HELPER
 
+#include <cassert>
+#include <type_traits>
+
 namespace CASE {
 
 // n mod MAX with floored division, so as to wrap backwards around negative n
-template <int MAX>
-inline int wrap(const int n) {
+template <int MAX, class N = int>
+inline N wrap(const N n) {
+    static_assert(MAX > 0, "wrap MAX must be > 0.");
+    // two's complement makes the mask wrap negative n as well
+    if ((MAX & (MAX - 1)) == 0)
+        return n & N(MAX - 1);
     return ((n % MAX) + MAX) % MAX;
 }
 
-inline int wrap(const int n, const int MAX) {
+template <class N, class M>
+inline typename std::common_type<N, M>::type wrap(const N n, const M MAX) {
     return ((n % MAX) + MAX) % MAX;
 }
 
+namespace _impl {
+// A width or height of a grid, N when it is fixed at compile time so that
+// division and wrapping by it are strength reduced, otherwise the value
+// given at runtime.
+template <int N>
+struct Extent {
+    static_assert(N > 0, "Extent N must be > 0.");
+    Extent(const int runtime) {
+        assert(runtime == 0 || runtime == N);
+        (void)runtime;
+    }
+    constexpr int operator()() const { return N; }
+    template <class T>
+    T wrap(const T n) const { return CASE::wrap<N>(n); }
+};
+
+template <>
+struct Extent<0> {
+    int n;
+    Extent(const int runtime) : n(runtime) {}
+    int operator()() const { return n; }
+    template <class T>
+    T wrap(const T v) const { return CASE::wrap(v, T(n)); }
+};
+} // _impl
+
 template <int A, int B>
 inline int clamp(const int n) {
     return n < A ? A : n > B ? B : n;
@@ -5,16 +5,49 @@
 #define CASE_INDEX
 
 #include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
 #include "helper.hpp"
 
 namespace CASE {
 
-// row-major major matrix index 
-inline int index(const int x, const int y, const int size) {
+// row-major major matrix index, computed in the widest argument type
+template <class X, class Y, class S>
+inline typename std::common_type<X, Y, S>::type
+index(const X x, const Y y, const S size) {
     assert(size > 0);
-    return y * size + x;
+    using Index = typename std::common_type<X, Y, S>::type;
+    return static_cast<Index>(y) * size + x;
 }
 
+// the Z-order (Morton) index of (x, y), which interleaves their bits so
+// that cells close in the plane are mostly close in the order
+inline std::uint64_t morton(const std::uint32_t x, const std::uint32_t y) {
+    const auto spread = [](std::uint64_t v) {
+        v = (v | v << 16) & 0x0000ffff0000ffffull;
+        v = (v | v << 8) & 0x00ff00ff00ff00ffull;
+        v = (v | v << 4) & 0x0f0f0f0f0f0f0f0full;
+        v = (v | v << 2) & 0x3333333333333333ull;
+        return (v | v << 1) & 0x5555555555555555ull;
+    };
+    return spread(x) | spread(y) << 1;
+}
+
+// The index type of an agent or cell is the type of its index member, int
+// if it has none. Worlds beyond 2^31 cells declare a signed 64-bit index
+// member, such as long long, since neighbours are found by adding negative
+// offsets to it.
+template <class T, class = void>
+struct index_type {
+    using type = int;
+};
+
+template <class T>
+struct index_type<T, decltype(void(std::declval<T &>().index))> {
+    using type = typename std::decay<decltype(std::declval<T &>().index)>::type;
+};
+
 namespace _impl {
 template<class T>
 inline T & bda(T * t, int i, int c, int r, int x, int y) {
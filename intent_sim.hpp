@@ -0,0 +1,693 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_INTENT_SIM
+#define CASE_INTENT_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+#include "helper.hpp"
+#include "pair.hpp"
+#include "job.hpp"
+#include "timer.hpp"
+#include "log.hpp"
+#include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+
+namespace CASE {
+
+// How agents claiming the same empty cell are settled: a random one wins,
+// the one with the highest priority(), or the one whose hash with the
+// generation is lowest. All three are independent of thread count.
+enum class Resolution { Random, Priority, Hash };
+
+// true if the agent has int priority() const
+template <class T, class = void>
+struct has_priority : std::false_type {};
+
+template <class T>
+struct has_priority<T, decltype(void(std::declval<const T &>().priority()))>
+    : std::true_type {};
+
+// true if the agent has void receive(long), for transfers
+template <class T, class = void>
+struct has_receive : std::false_type {};
+
+template <class T>
+struct has_receive<T, decltype(void(std::declval<T &>().receive(1L)))>
+    : std::true_type {};
+
+namespace _impl {
+template <class Agent>
+int priority(const Agent & agent, std::true_type) { return agent.priority(); }
+
+template <class Agent>
+int priority(const Agent &, std::false_type) { return 0; }
+
+template <class Agent>
+void receive(Agent & agent, const long amount, std::true_type) {
+    agent.receive(amount);
+}
+
+template <class Agent>
+void receive(Agent &, long, std::false_type) {
+    assert(false && "transfer() to an agent without receive(long)");
+}
+} // _impl
+
+// A world of agents that take turns in two phases. First every agent acts
+// on a read-only view of the last generation, writing only its own next
+// state and emitting intents: move, spawn, kill and transfer. Then the
+// intents are resolved per target cell, each worker settling those of its
+// own band of cells, in a fixed order:
+//   kills and transfers, summed per target, to the agent at the start of
+//   the generation, kills first;
+//   moves and spawns of living agents into cells that were empty at the
+//   start of the generation, one winner each by the Resolution.
+// The agent needs
+//   int z;     its layer
+//   void act(Agent & next, const IntentWorld<Agent>::View &,
+//            IntentWorld<Agent>::Intents &) const;
+//   void draw(int x, int y, std::vector<sf::Vertex> &) const;
+// and, for transfers and Resolution::Priority, void receive(long) and
+// int priority() const.
+template <class Agent, class Index = int>
+class IntentWorld {
+public:
+    struct Intent {
+        enum class Kind : std::uint8_t { Kill, Transfer, Move, Spawn };
+        Kind kind;
+        int layer;
+        Index cell;         // target
+        Index source;       // slot of the agent that emitted it
+        int sequence;       // among the intents of its source
+        long amount;
+        Agent agent;        // the agent to spawn
+
+        bool operator<(const Intent & other) const {
+            if (cell != other.cell) return cell < other.cell;
+            if (layer != other.layer) return layer < other.layer;
+            if (kind != other.kind) return kind < other.kind;
+            if (source != other.source) return source < other.source;
+            return sequence < other.sequence;
+        }
+    };
+
+private:
+    int columns = 0, rows = 0, layers = 0;
+    Index cells = 0, slots = 0;
+    Resolution resolution = Resolution::Random;
+    std::uint64_t seed = 0;
+    long generation = 0;
+
+    Pair<std::vector<Agent>> agents;
+    std::vector<Index> cell_of;                 // of each slot
+    std::vector<std::uint8_t> alive;            // of each slot
+    Pair<std::vector<Index>> occupant;          // of each cell and layer, -1 if none
+    std::priority_queue<Index, std::vector<Index>, std::greater<Index>> free;
+
+    // what each worker owns between the passes
+    struct Band {
+        std::vector<std::vector<Intent>> outbox;    // by destination band
+        std::vector<Intent> inbox;
+        std::vector<Intent> spawns;
+        std::vector<Index> freed;
+    };
+    std::vector<Band> bands;
+
+    // each worker resolves the intents targeting its own band of rows
+    std::vector<int> row_owner;
+
+    int owner(const Index cell) const {
+        return row_owner[cell / columns];
+    }
+
+    Index first_cell(const int band) const {
+        const auto n = static_cast<long long>(bands.size());
+        return static_cast<Index>(rows * band / n) * columns;
+    }
+
+    Index slot(const Index cell, const int layer) const {
+        return cell * layers + layer;
+    }
+
+    // the offsets agents use are mostly within a cell or two
+    static int shift(const int v, const int d, const int size) {
+        const auto w = v + d;
+        if (w >= 0 && w < size)
+            return w;
+        return wrap(w, size);
+    }
+
+    Index cell(const int x, const int y, const int dx, const int dy) const {
+        return static_cast<Index>(shift(y, dy, rows)) * columns
+             + shift(x, dx, columns);
+    }
+
+public:
+    // what an agent sees while it acts: the world at the start of the
+    // generation, and random numbers that depend only on the agent, the
+    // generation and how many it drew before
+    class View {
+        const IntentWorld & world;
+        const Index source;
+        mutable std::uint64_t draws = 0;
+
+    public:
+        const int x, y;
+
+        View(const IntentWorld & w, const Index s)
+            : world(w), source(s),
+              x(static_cast<int>(w.cell_of[s] % w.columns)),
+              y(static_cast<int>(w.cell_of[s] / w.columns))
+        {}
+
+        const Agent & self() const { return world.agents.current()[source]; }
+
+        // the agent in layer of the cell at offset (dx, dy), if any
+        const Agent * operator()(const int dx, const int dy,
+                                 const int layer) const
+        {
+            assert(layer >= 0 && layer < world.layers);
+            const auto s = world.occupant.current()[
+                world.slot(world.cell(x, y, dx, dy), layer)];
+            return s < 0 ? nullptr : &world.agents.current()[s];
+        }
+
+        // uniform in [a, b], by multiplying rather than dividing
+        int random(const int a, const int b) const {
+            assert(a <= b);
+            const auto key = (std::uint64_t(world.generation) << 32) ^ draws++;
+            const auto h = state_hash(std::uint64_t(source) ^ world.seed, key);
+            const auto range = std::uint64_t(b - a) + 1;
+            return a + static_cast<int>(((h >> 32) * range) >> 32);
+        }
+    };
+
+    // where an agent emits its intents while it acts, sorted into the
+    // outboxes of the bands that resolve them
+    class Intents {
+        IntentWorld & world;
+        Band & band;
+        const Index source;
+        const int x, y, z;
+        int sequence = 0;
+        bool moved = false;
+
+        void post(const typename Intent::Kind kind, const int dx, const int dy,
+                  const int layer, const long amount, const Agent & agent)
+        {
+            assert(layer >= 0 && layer < world.layers);
+            const auto target = world.cell(x, y, dx, dy);
+            band.outbox[world.owner(target)].push_back(
+                Intent{kind, layer, target, source, sequence++, amount, agent});
+        }
+
+    public:
+        Intents(IntentWorld & w, Band & b, const Index s, const int _x,
+                const int _y, const int _z)
+            : world(w), band(b), source(s), x(_x), y(_y), z(_z)
+        {}
+
+        // to the cell at offset (dx, dy), at most once per generation
+        void move(const int dx, const int dy) {
+            assert(moved == false);
+            moved = true;
+            post(Intent::Kind::Move, dx, dy, z, 0, Agent{});
+        }
+
+        // a new agent in layer agent.z of the cell at offset (dx, dy)
+        void spawn(const int dx, const int dy, const Agent & agent) {
+            post(Intent::Kind::Spawn, dx, dy, agent.z, 0, agent);
+        }
+
+        // removes the agent in layer of the cell at offset (dx, dy)
+        void kill(const int dx, const int dy, const int layer) {
+            post(Intent::Kind::Kill, dx, dy, layer, 0, Agent{});
+        }
+
+        void die() { kill(0, 0, z); }
+
+        // calls receive() of the agent in layer of the cell at offset
+        // (dx, dy), once, with the sum of the amounts sent to it
+        void transfer(const int dx, const int dy, const int layer,
+                      const long amount)
+        {
+            post(Intent::Kind::Transfer, dx, dy, layer, amount, Agent{});
+        }
+    };
+
+    IntentWorld(const int c, const int r, const int l, const Resolution how,
+                const std::uint64_t s = 0)
+        : columns(c), rows(r), layers(l), resolution(how), seed(s)
+    {
+        assert(c >= 1 && r >= 1 && l >= 1);
+        cells = static_cast<Index>(c) * r;
+        slots = cells * l;
+        agents.current().resize(slots);
+        agents.next().resize(slots);
+        cell_of.resize(slots);
+        alive.resize(slots);
+        occupant.current().resize(slots);
+        occupant.next().resize(slots);
+        prepare(1);
+        clear();
+    }
+
+    // sets up the buffers of this many workers
+    void prepare(const int workers) {
+        bands.assign(workers, Band{});
+        for (auto & band : bands)
+            band.outbox.resize(workers);
+        row_owner.resize(rows);
+        for (auto b = 0; b < workers; b++) {
+            for (auto y = first_cell(b) / columns; y < first_cell(b + 1) / columns; y++)
+                row_owner[y] = b;
+        }
+    }
+
+    void clear() {
+        std::fill(cell_of.begin(), cell_of.end(), Index(-1));
+        std::fill(alive.begin(), alive.end(), 0);
+        std::fill(occupant.current().begin(), occupant.current().end(), Index(-1));
+        free = decltype(free){};
+        for (Index s = 0; s < slots; s++)
+            free.push(s);
+        generation = 0;
+    }
+
+    // places an agent outside of a generation, e.g. in init(), if its cell
+    // and a slot are free
+    const Agent * spawn(const int x, const int y, const Agent & agent) {
+        assert(agent.z >= 0 && agent.z < layers);
+        const auto c = cell(x, y, 0, 0);
+        auto & here = occupant.current()[slot(c, agent.z)];
+        if (here >= 0 || free.empty())
+            return nullptr;
+        const auto s = free.top();
+        free.pop();
+        agents.current()[s] = agent;
+        cell_of[s] = c;
+        alive[s] = 1;
+        here = s;
+        return &agents.current()[s];
+    }
+
+    const Agent * operator()(const int x, const int y, const int layer) const {
+        const auto s = occupant.current()[slot(cell(x, y, 0, 0), layer)];
+        return s < 0 ? nullptr : &agents.current()[s];
+    }
+
+    Index popcount() const {
+        return slots - static_cast<Index>(free.size());
+    }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+    int depth() const { return layers; }
+
+    // the first pass: agents in slots of band act
+    void act(const int band) {
+        const auto n = static_cast<long long>(bands.size());
+        const auto first = static_cast<Index>(slots * band / n);
+        const auto last = static_cast<Index>(slots * (band + 1) / n);
+        auto & mine = bands[band];
+        for (auto & box : mine.outbox)
+            box.clear();
+        const auto & current = agents.current();
+        auto & next = agents.next();
+        for (auto s = first; s < last; s++) {
+            if (alive[s] == 0)
+                continue;
+            next[s] = current[s];
+            const View view{*this, s};
+            Intents intents{*this, mine, s, view.x, view.y, current[s].z};
+            current[s].act(next[s], view, intents);
+        }
+    }
+
+    // the second: kills and transfers into the cells of band
+    void settle(const int band) {
+        auto & mine = bands[band];
+        const auto first = first_cell(band), last = first_cell(band + 1);
+        std::copy(occupant.current().begin() + slot(first, 0),
+                  occupant.current().begin() + slot(last, 0),
+                  occupant.next().begin() + slot(first, 0));
+
+        mine.inbox.clear();
+        for (auto & from : bands)
+            mine.inbox.insert(mine.inbox.end(), from.outbox[band].begin(),
+                              from.outbox[band].end());
+        std::sort(mine.inbox.begin(), mine.inbox.end());
+        mine.freed.clear();
+
+        using Kind = typename Intent::Kind;
+        const auto & inbox = mine.inbox;
+        for (std::size_t i = 0; i < inbox.size();) {
+            auto end = i + 1;
+            while (end < inbox.size() && inbox[end].cell == inbox[i].cell
+                   && inbox[end].layer == inbox[i].layer
+                   && inbox[end].kind == inbox[i].kind)
+                end++;
+            const auto at = slot(inbox[i].cell, inbox[i].layer);
+            const auto target = occupant.current()[at];
+            if (target >= 0 && alive[target] && inbox[i].kind == Kind::Kill) {
+                alive[target] = 0;
+                occupant.next()[at] = -1;
+                mine.freed.push_back(target);
+            }
+            else if (target >= 0 && alive[target]
+                     && inbox[i].kind == Kind::Transfer) {
+                long sum = 0;
+                for (auto j = i; j < end; j++)
+                    sum += inbox[j].amount;
+                _impl::receive(agents.next()[target], sum, has_receive<Agent>{});
+            }
+            i = end;
+        }
+    }
+
+    // the third: moves and spawns into the cells of band
+    void claim(const int band) {
+        auto & mine = bands[band];
+        mine.spawns.clear();
+
+        using Kind = typename Intent::Kind;
+        const auto & inbox = mine.inbox;
+        const auto & current = agents.current();
+        const auto key = std::uint64_t(generation) ^ seed;
+        std::vector<const Intent *> claims;
+        for (std::size_t i = 0; i < inbox.size();) {
+            auto end = i + 1;
+            while (end < inbox.size() && inbox[end].cell == inbox[i].cell
+                   && inbox[end].layer == inbox[i].layer)
+                end++;
+            const auto at = slot(inbox[i].cell, inbox[i].layer);
+            claims.clear();
+            if (occupant.current()[at] < 0) {
+                for (auto j = i; j < end; j++) {
+                    const auto & intent = inbox[j];
+                    if (intent.kind >= Kind::Move && alive[intent.source])
+                        claims.push_back(&intent);
+                }
+            }
+            i = end;
+            if (claims.empty())
+                continue;
+
+            auto winner = claims.front();
+            if (resolution == Resolution::Random)
+                winner = claims[state_hash(std::uint64_t(at), key) % claims.size()];
+            else if (resolution == Resolution::Priority) {
+                auto best = 0;
+                for (const auto c : claims) {
+                    const auto & agent = c->kind == Kind::Move
+                                       ? current[c->source] : c->agent;
+                    const auto p = _impl::priority(agent, has_priority<Agent>{});
+                    if (c == claims.front() || p > best) {
+                        best = p;
+                        winner = c;
+                    }
+                }
+            }
+            else {
+                const auto rank = [key](const Intent * c) {
+                    return state_hash(std::uint64_t(c->source) << 8 ^ c->sequence, key);
+                };
+                for (const auto c : claims) {
+                    if (rank(c) < rank(winner))
+                        winner = c;
+                }
+            }
+
+            if (winner->kind == Kind::Spawn) {
+                mine.spawns.push_back(*winner);
+                continue;
+            }
+            // the cell left behind was occupied at the start, so no other
+            // band writes it in this pass
+            const auto s = winner->source;
+            occupant.next()[slot(cell_of[s], winner->layer)] = -1;
+            occupant.next()[at] = s;
+            cell_of[s] = winner->cell;
+        }
+    }
+
+    // the last, serially: frees the slots of the dead, places the spawned
+    // in the lowest free slots in cell order, and makes next current
+    void commit() {
+        for (const auto & band : bands) {
+            for (const auto s : band.freed) {
+                cell_of[s] = -1;
+                free.push(s);
+            }
+        }
+        auto & next = agents.next();
+        for (const auto & band : bands) {
+            for (const auto & intent : band.spawns) {
+                if (free.empty())
+                    break;
+                const auto s = free.top();
+                free.pop();
+                next[s] = intent.agent;
+                cell_of[s] = intent.cell;
+                alive[s] = 1;
+                occupant.next()[slot(intent.cell, intent.layer)] = s;
+            }
+        }
+        agents.flip();
+        occupant.flip();
+        generation++;
+    }
+
+    // hashes where each agent is, which is the same for any thread count
+    std::uint64_t checksum() {
+        std::uint64_t sum = 0;
+        const auto & occupied = occupant.current();
+        for (Index i = 0; i < slots; i++) {
+            if (occupied[i] >= 0)
+                sum += state_hash(std::uint64_t(i), std::uint64_t(occupied[i]));
+        }
+        return sum;
+    }
+
+    template <class Vertices>
+    void draw(Vertices & vertices) const {
+        const auto & occupied = occupant.current();
+        for (Index c = 0; c < cells; c++) {
+            for (auto layer = layers - 1; layer >= 0; --layer) {
+                const auto s = occupied[slot(c, layer)];
+                if (s >= 0) {
+                    agents.current()[s].draw(static_cast<int>(c % columns),
+                                             static_cast<int>(c / columns),
+                                             vertices);
+                }
+            }
+        }
+    }
+};
+
+template <class World>
+class IntentJob : public Job {
+public:
+    enum class Pass { Act, Settle, Claim };
+
+private:
+    World * world = nullptr;
+    Pass pass = Pass::Act;
+
+    void execute() override {
+        PhaseScope scope{Phase::Update};
+        if (pass == Pass::Act)
+            world->act(nth);
+        else if (pass == Pass::Settle)
+            world->settle(nth);
+        else
+            world->claim(nth);
+    }
+
+    const char * name() const override { return "intent"; }
+
+public:
+    using Job::Job;
+
+    void upload(World & w, const Pass p) {
+        wait();
+        world = &w;
+        pass = p;
+    }
+};
+
+namespace _impl {
+template <class Config>
+Resolution resolution(const Config & config, std::true_type) {
+    return config.resolution;
+}
+
+template <class Config>
+Resolution resolution(const Config &, std::false_type) {
+    return Resolution::Random;
+}
+} // _impl
+
+template <class Config, class = void>
+struct has_resolution : std::false_type {};
+
+template <class Config>
+struct has_resolution<Config, decltype(void(std::declval<Config &>().resolution))>
+    : std::true_type {};
+
+// Runs agents by intents, see IntentWorld. The config provides
+//   using Agent = ...;
+//   int columns, rows, layers, cell_size;
+//   double framerate;
+//   const char * title;
+//   sf::Color bgcolor;
+//   void init(IntentWorld<Agent> &);
+//   void postprocessing(IntentWorld<Agent> &);  after each generation
+// and optionally CASE::Resolution resolution, Random by default.
+template <class Config>
+void Resolved() {
+    Config config;
+    name_thread("main");
+
+    using Agent = typename Config::Agent;
+    using World = IntentWorld<Agent>;
+    using Pass = typename IntentJob<World>::Pass;
+    static_assert(std::is_trivially_copyable<Agent>::value,
+                  "Resolved() agents must be trivially copyable.");
+
+#ifndef CASE_HEADLESS
+    sf::RenderWindow window;
+    window.create(sf::VideoMode(config.columns * config.cell_size,
+                                config.rows * config.cell_size), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+#endif
+
+    World world{config.columns, config.rows, config.layers,
+                _impl::resolution(config, has_resolution<Config>{})};
+
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+    world.prepare(threads);
+
+    std::list<IntentJob<World>> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    auto run = [&](const Pass pass) {
+        for (auto & job : update_jobs) {
+            job.upload(world, pass);
+            job.launch();
+        }
+        PhaseScope scope{Phase::Barrier};
+        for (auto & job : update_jobs)
+            job.wait();
+    };
+
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        const auto n = world.popcount();
+        perf_units(n, "agent");
+        run(Pass::Act);
+        run(Pass::Settle);
+        run(Pass::Claim);
+        {
+            PhaseScope scope{Phase::Flip};
+            world.commit();
+        }
+        PhaseScope scope{Phase::Postprocessing};
+        config.postprocessing(world);
+        return n;
+    };
+
+    auto reset = [&]() {
+        world.clear();
+        config.init(world);
+    };
+    reset();
+
+#ifdef CASE_HEADLESS
+    headless({config.title, "resolved", "agent", config.columns, config.rows,
+              threads},
+             [&]() { return update(); },
+             [&]() {},
+             [&]() { return world.checksum(); });
+#else
+    auto framerate = config.framerate;
+    std::vector<sf::Vertex> vertices;
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double dt = 0.0;
+    Timer timer;
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+                update();
+            }
+        }
+
+        {
+            PhaseScope scope{Phase::Vertices};
+            vertices.clear();
+            world.draw(vertices);
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(vertices.data(), vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+    for (auto & job : update_jobs)
+        job.terminate();
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_INTENT_SIM
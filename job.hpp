@@ -4,12 +4,25 @@
 #ifndef CASE_JOB
 #define CASE_JOB
 
+#include <algorithm>
+#include <cstdlib>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
 
+#include "profile.hpp"
+
 namespace CASE {
 
+// Number of worker threads, $CASE_THREADS if set, otherwise one less than
+// the hardware concurrency, with a minimum of 1.
+inline int worker_count() {
+    const auto env = std::getenv("CASE_THREADS");
+    if (env != nullptr && std::atoi(env) > 0)
+        return std::atoi(env);
+    return std::max<int>(std::thread::hardware_concurrency() - 1, 1);
+}
+
 class Job {
     enum class Access { Open, Closed };
     Access access = Access::Closed;
@@ -24,6 +37,9 @@ class Job {
 
     virtual void execute() = 0;
 
+    // used to label the job in traces
+    virtual const char * name() const { return "job"; }
+
 protected:
     const int nth;
     const int n_threads;
@@ -41,6 +57,7 @@ public:
 
     void wait() {
         if (access == Access::Closed) {
+            TraceScope scope{name(), "wait", nth};
             std::unique_lock<std::mutex> lock_done{mutex_done};
             cv_done.wait(lock_done, [this]{ return flag_done; });
             flag_done = false;
@@ -50,6 +67,7 @@ public:
 
     void launch() {
         wait();
+        TraceScope scope{name(), "launch", nth};
         {
             std::lock_guard<std::mutex> lock_launch{mutex_launch};
             flag_launch = true;
@@ -68,6 +86,7 @@ public:
     }
 
     void run() {
+        name_thread(name(), nth);
         while (true) {
             {
                 std::unique_lock<std::mutex> lock_launch{mutex_launch};
@@ -81,8 +100,10 @@ public:
             }
             if (flag_terminate)
                 break;
-            else
+            else {
+                TraceScope scope{name(), "execute", nth};
                 execute();
+            }
         }
         std::lock_guard<std::mutex> lock_done{mutex_done};
         flag_done = true;
@@ -0,0 +1,405 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_LINE_SIM
+#define CASE_LINE_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "helper.hpp"
+#include "quad.hpp"
+#include "timer.hpp"
+#include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+
+namespace CASE {
+
+// The rule of a one dimensional automaton with states 0 .. states - 1.
+// The next state of a cell is table[p], where p reads the 2 * radius + 1
+// cells around it as a number in base states, the leftmost cell the most
+// significant digit, or table[s] where s is the sum of their states if the
+// rule is totalistic.
+struct LineRule {
+    int states = 2;
+    int radius = 1;
+    bool totalistic = false;
+    std::vector<std::uint8_t> table;
+
+    int width() const { return 2 * radius + 1; }
+
+    bool operator==(const LineRule & other) const {
+        return states == other.states && radius == other.radius
+            && totalistic == other.totalistic && table == other.table;
+    }
+};
+
+// A two state rule of the given radius where bit p of code is the next
+// state for pattern p. Radius 1 gives Wolfram's numbering of the 256
+// elementary rules.
+inline LineRule binary_rule(const int radius, const std::uint64_t code) {
+    assert(radius >= 1 && radius <= 2);
+    LineRule rule;
+    rule.radius = radius;
+    rule.table.resize(std::size_t{1} << rule.width());
+    for (auto p = 0u; p < rule.table.size(); p++)
+        rule.table[p] = (code >> p) & 1;
+    return rule;
+}
+
+inline LineRule elementary_rule(const int code) {
+    assert(code >= 0 && code < 256);
+    return binary_rule(1, code);
+}
+
+// A totalistic rule, where digit s of code in base states is the next
+// state for a sum of s.
+inline LineRule totalistic_rule(const int states, const int radius,
+                                std::uint64_t code)
+{
+    assert(states >= 2 && states <= 256 && radius >= 1);
+    LineRule rule;
+    rule.states = states;
+    rule.radius = radius;
+    rule.totalistic = true;
+    rule.table.resize(rule.width() * (states - 1) + 1);
+    for (auto & next : rule.table) {
+        next = code % states;
+        code /= states;
+    }
+    return rule;
+}
+
+// The last rows generations of a ring of columns cells, the oldest
+// overwritten by each new one. Two state rules keep 64 cells to a word and
+// advance a word at a time, through a tree of multiplexers on the shifted
+// neighbour words whose leaves are the rule's table.
+class LineWorld {
+    int columns = 0;
+    int rows = 0;
+    int states = 2;
+    bool packed = false;
+    int words = 0;
+    long long generation = 0;
+    std::vector<std::uint64_t> bits;    // rows x words, when packed
+    std::vector<std::uint8_t> bytes;    // rows x columns, otherwise
+
+    // the rule last stepped with, compiled
+    LineRule compiled;
+    std::vector<std::uint64_t> leaves;  // by pattern, all ones or zeros
+    std::vector<std::uint8_t> lookup;   // by pattern or sum
+
+    std::uint64_t * packed_row(const long long g) {
+        return bits.data() + std::size_t(g % rows) * words;
+    }
+
+    const std::uint64_t * packed_row(const long long g) const {
+        return bits.data() + std::size_t(g % rows) * words;
+    }
+
+    std::uint8_t * byte_row(const long long g) {
+        return bytes.data() + std::size_t(g % rows) * columns;
+    }
+
+    const std::uint8_t * byte_row(const long long g) const {
+        return bytes.data() + std::size_t(g % rows) * columns;
+    }
+
+    // count <= 64 cells from start, which must not pass the end of the row
+    static std::uint64_t read(const std::uint64_t * row, const int start,
+                              const int count)
+    {
+        const auto w = start >> 6, s = start & 63;
+        auto value = row[w] >> s;
+        if (s + count > 64)
+            value |= row[w + 1] << (64 - s);
+        return count == 64 ? value : value & ((std::uint64_t{1} << count) - 1);
+    }
+
+    // 64 cells from start, wrapping around the ends of the row
+    std::uint64_t extract(const std::uint64_t * row, int start) const {
+        start = wrap(start, columns);
+        if (start + 64 <= columns)
+            return read(row, start, 64);
+        auto count = columns - start;
+        auto value = read(row, start, count);
+        while (count < 64) {
+            const auto n = std::min(64 - count, columns);
+            value |= read(row, 0, n) << count;
+            count += n;
+        }
+        return value;
+    }
+
+    void compile(const LineRule & rule) {
+        assert(rule.states == states);
+        assert(packed == false || rule.radius <= 2);
+        compiled = rule;
+        lookup = rule.table;
+        if (packed == false)
+            return;
+        // a totalistic rule as the table of its patterns
+        const auto patterns = 1u << rule.width();
+        leaves.assign(patterns, 0);
+        for (auto p = 0u; p < patterns; p++) {
+            auto index = p;
+            if (rule.totalistic) {
+                index = 0;
+                for (auto q = p; q != 0; q >>= 1)
+                    index += q & 1;
+            }
+            assert(index < rule.table.size());
+            leaves[p] = rule.table[index] ? ~std::uint64_t{0} : 0;
+        }
+    }
+
+    void step_packed() {
+        const auto width = compiled.width();
+        const auto radius = compiled.radius;
+        const auto current = packed_row(generation);
+        const auto next = packed_row(generation + 1);
+        std::uint64_t inputs[5];
+        std::uint64_t tree[32];
+
+        for (auto i = 0; i < words; i++) {
+            for (auto k = 0; k < width; k++)
+                inputs[k] = extract(current, 64 * i + k - radius);
+            // each level selects on one cell, the rightmost first
+            std::copy(leaves.begin(), leaves.end(), tree);
+            for (auto k = width - 1, half = int(leaves.size()) / 2; k >= 0;
+                 k--, half /= 2)
+            {
+                const auto select = inputs[k];
+                for (auto q = 0; q < half; q++)
+                    tree[q] = (select & tree[2 * q + 1])
+                            | (~select & tree[2 * q]);
+            }
+            next[i] = tree[0];
+        }
+        // cells past the end of the row stay 0
+        if (columns % 64 != 0)
+            next[words - 1] &= (std::uint64_t{1} << (columns % 64)) - 1;
+    }
+
+    void step_bytes() {
+        const auto radius = compiled.radius;
+        const auto current = byte_row(generation);
+        const auto next = byte_row(generation + 1);
+        for (auto x = 0; x < columns; x++) {
+            auto index = 0;
+            for (auto d = -radius; d <= radius; d++) {
+                const auto c = x + d;
+                const auto state = current[c >= 0 && c < columns
+                                           ? c : wrap(c, columns)];
+                index = compiled.totalistic ? index + state
+                                            : index * states + state;
+            }
+            assert(index < int(lookup.size()));
+            next[x] = lookup[index];
+        }
+    }
+
+public:
+    // the world keeps the number of states of rule, and packs cells if it
+    // has 2 states and a radius of at most 2
+    LineWorld(const int c, const int r, const LineRule & rule)
+        : columns(c), rows(r), states(rule.states),
+          packed(rule.states == 2 && rule.radius <= 2), words((c + 63) / 64)
+    {
+        assert(columns >= 1 && rows >= 1);
+        assert(states >= 2 && states <= 256);
+        if (packed)
+            bits.assign(std::size_t(rows) * words, 0);
+        else
+            bytes.assign(std::size_t(rows) * columns, 0);
+    }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+
+    // the generation of the newest row, 0 after clear()
+    long long newest() const { return generation; }
+
+    // state of cell x in generation g, one of the last rows generations
+    int operator()(const int x, const long long g) const {
+        assert(x >= 0 && x < columns);
+        assert(g <= generation && g > generation - rows && g >= 0);
+        if (packed)
+            return (packed_row(g)[x >> 6] >> (x & 63)) & 1;
+        return byte_row(g)[x];
+    }
+
+    // state of cell x in the newest generation
+    int operator()(const int x) const {
+        return (*this)(x, generation);
+    }
+
+    // sets cell x of the newest generation
+    void set(const int x, const int state) {
+        assert(x >= 0 && x < columns);
+        assert(state >= 0 && state < states);
+        if (packed) {
+            auto & word = packed_row(generation)[x >> 6];
+            const auto bit = std::uint64_t{1} << (x & 63);
+            word = state != 0 ? word | bit : word & ~bit;
+        }
+        else
+            byte_row(generation)[x] = state;
+    }
+
+    void clear() {
+        generation = 0;
+        std::fill(bits.begin(), bits.end(), 0);
+        std::fill(bytes.begin(), bytes.end(), 0);
+    }
+
+    // appends the next generation by rule
+    void step(const LineRule & rule) {
+        if ((compiled == rule) == false)
+            compile(rule);
+        if (packed)
+            step_packed();
+        else
+            step_bytes();
+        generation++;
+    }
+};
+
+// Runs a one dimensional automaton, showing its last rows generations from
+// the oldest at the top to the newest at the bottom. The config provides
+//   int columns, rows, cell_size;
+//   double framerate;
+//   const char * title;
+//   sf::Color bgcolor;
+//   LineRule rule;                      read every generation
+//   void init(LineWorld &);             sets the first generation
+//   void postprocessing(LineWorld &);   before each generation
+// State s is drawn as grey 255 - 255 * s / (states - 1).
+template <class Config>
+void Line() {
+    Config config;
+    name_thread("main");
+
+    const auto columns = config.columns;
+    const auto rows = config.rows;
+    LineWorld world{columns, rows, config.rule};
+
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(columns, "cell");
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world);
+        }
+        PhaseScope scope{Phase::Update};
+        world.step(config.rule);
+    };
+
+    auto reset = [&]() {
+        world.clear();
+        config.init(world);
+    };
+
+#ifdef CASE_HEADLESS
+    reset();
+    headless({config.title, "line", "cell", columns, rows, 1},
+             [&]() { update(); return columns; },
+             [&]() {},
+             [&]() {
+                 std::uint64_t sum = 0;
+                 for (auto x = 0; x < columns; x++)
+                     sum += state_hash(x, world(x));
+                 return sum;
+             });
+#else
+    sf::RenderWindow window;
+    window.create(sf::VideoMode(columns * config.cell_size,
+                                rows * config.cell_size), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+
+    const auto states = config.rule.states;
+    std::vector<sf::Vertex> vertices(std::size_t(columns) * rows * 4);
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++) {
+            quad(x * config.cell_size, y * config.cell_size, config.cell_size,
+                 config.cell_size, &vertices[(std::size_t(y) * columns + x) * 4]);
+        }
+    }
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double framerate = config.framerate;
+    double dt = 0.0;
+    Timer timer;
+
+    reset();
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+                update();
+            }
+        }
+
+        {
+            PhaseScope scope{Phase::Vertices};
+            const auto first = world.newest() - rows + 1;
+            for (auto y = 0; y < rows; y++) {
+                for (auto x = 0; x < columns; x++) {
+                    auto vs = &vertices[(std::size_t(y) * columns + x) * 4];
+                    if (first + y < 0) {
+                        const auto c = config.bgcolor;
+                        quad(int(c.r), int(c.g), int(c.b), vs);
+                        continue;
+                    }
+                    const auto shade = 255 - 255 * world(x, first + y)
+                                                 / (states - 1);
+                    quad(shade, shade, shade, vs);
+                }
+            }
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(&vertices[0], vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_LINE_SIM
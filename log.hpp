@@ -4,73 +4,368 @@
 #ifndef CASE_LOG
 #define CASE_LOG
 
+#include <cassert>
 #include <ctime>
 #include <chrono>
 #include <atomic>
 #include <thread>
 #include <mutex>
+#include <memory>
+#include <vector>
 #include <sstream>
+#include <string>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <stdexcept>
 #include <fstream>
 
 namespace CASE {
 
+namespace _impl {
+
+// A log argument is stored in binary form and only turned into text by the
+// writer thread. Strings are copied into their record, see LogRecord.
+struct LogArg {
+    enum Type : unsigned char { Int, Uint, Float, Bool, Char, String };
+    Type type = Int;
+    union {
+        long long i;
+        unsigned long long u;
+        double f;
+        const char * s;     // until copied into the record
+        std::size_t offset; // of the copy in the text of the record
+    };
+    LogArg() : i(0) {}
+};
+
+inline LogArg logarg(const bool b) {
+    LogArg arg; arg.type = LogArg::Bool; arg.u = b; return arg;
+}
+
+inline LogArg logarg(const char c) {
+    LogArg arg; arg.type = LogArg::Char; arg.i = c; return arg;
+}
+
+inline LogArg logarg(const char * s) {
+    LogArg arg; arg.type = LogArg::String; arg.s = s; return arg;
+}
+
+inline LogArg logarg(const std::string & s) {
+    return logarg(s.c_str());
+}
+
+template <class T>
+inline typename std::enable_if<std::is_integral<T>::value
+                               && std::is_signed<T>::value, LogArg>::type
+logarg(const T t) {
+    LogArg arg; arg.type = LogArg::Int; arg.i = t; return arg;
+}
+
+template <class T>
+inline typename std::enable_if<std::is_integral<T>::value
+                               && std::is_unsigned<T>::value, LogArg>::type
+logarg(const T t) {
+    LogArg arg; arg.type = LogArg::Uint; arg.u = t; return arg;
+}
+
+template <class T>
+inline typename std::enable_if<std::is_floating_point<T>::value, LogArg>::type
+logarg(const T t) {
+    LogArg arg; arg.type = LogArg::Float; arg.f = t; return arg;
+}
+
+// true if T is stored in a record as it is, see logarg()
+template <class T, class = void>
+struct is_loggable : std::false_type {};
+
+template <class T>
+struct is_loggable<T, decltype(void(logarg(std::declval<const T &>())))>
+    : std::true_type {};
+
+// The format must be a literal. String arguments are copied into text, and
+// cut short once it is full.
+struct LogRecord {
+    static constexpr int max_args = 8;
+    static constexpr std::size_t text_bytes = 128;
+    std::uint64_t time = 0; // ns since the log was opened
+    const char * format = nullptr;
+    int argc = 0;
+    LogArg args[max_args];
+    char text[text_bytes];
+
+    void copy_strings() {
+        std::size_t used = 0;
+        for (auto i = 0; i < argc; i++) {
+            auto & arg = args[i];
+            if (arg.type != LogArg::String)
+                continue;
+            const auto s = arg.s != nullptr ? arg.s : "(null)";
+            const auto length = std::min(std::strlen(s),
+                                         text_bytes - used - 1);
+            std::memcpy(text + used, s, length);
+            text[used + length] = '\0';
+            arg.offset = used;
+            used = std::min(used + length + 1, text_bytes - 1);
+        }
+    }
+};
+
+// Single producer, single consumer ring of records. The producer is the
+// thread that owns the ring, the consumer is the log writer thread.
+class LogRing {
+    std::vector<LogRecord> records;
+    const std::size_t mask;
+    char pad0[64];
+    std::atomic<std::size_t> head{0}; // keep producer and consumer indices
+    char pad1[64];                    // on separate cache lines
+    std::atomic<std::size_t> tail{0};
+    char pad2[64];
+
+public:
+    const std::thread::id owner;
+    std::atomic<std::uint64_t> dropped{0};
+
+    LogRing(const std::size_t capacity, const std::thread::id id)
+        : records(capacity), mask(capacity - 1), owner(id)
+    {
+        assert((capacity & mask) == 0);
+    }
+
+    bool push(const LogRecord & record) {
+        const auto h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == records.size())
+            return false;
+        records[h & mask] = record;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    template <class Container>
+    void drain(Container & out) {
+        const auto h = head.load(std::memory_order_acquire);
+        auto t = tail.load(std::memory_order_relaxed);
+        for (; t != h; t++)
+            out.push_back(records[t & mask]);
+        tail.store(t, std::memory_order_release);
+    }
+
+    bool empty() const {
+        return head.load(std::memory_order_acquire)
+            == tail.load(std::memory_order_acquire);
+    }
+};
+
+inline void format(std::string & out, const LogArg & arg, const char * text) {
+    char buffer[32];
+    switch (arg.type) {
+        case LogArg::Int:
+            std::snprintf(buffer, sizeof buffer, "%lld", arg.i);
+            break;
+        case LogArg::Uint:
+            std::snprintf(buffer, sizeof buffer, "%llu", arg.u);
+            break;
+        case LogArg::Float:
+            std::snprintf(buffer, sizeof buffer, "%g", arg.f);
+            break;
+        case LogArg::Bool:
+            out += arg.u ? "true" : "false";
+            return;
+        case LogArg::Char:
+            out += static_cast<char>(arg.i);
+            return;
+        case LogArg::String:
+            out += text + arg.offset;
+            return;
+    }
+    out += buffer;
+}
+
+// Substitutes each "{}" in the format with the next argument.
+inline void format(std::string & out, const LogRecord & record) {
+    char stamp[32];
+    std::snprintf(stamp, sizeof stamp, "%12.6f ", record.time / 1e9);
+    out += stamp;
+
+    auto arg = 0;
+    for (auto c = record.format; *c != '\0'; c++) {
+        if (c[0] == '{' && c[1] == '}' && arg < record.argc) {
+            format(out, record.args[arg++], record.text);
+            c++;
+        }
+        else
+            out += *c;
+    }
+    out += '\n';
+}
+
+} // _impl
+
+// Low overhead logger. Every thread that logs gets its own lock-free ring
+// buffer of binary records, formatting happens on the writer thread.
 class Log {
+public:
+    // what a producer does when its ring is full
+    enum class Overflow { Drop, Block };
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    const std::uint64_t id;
+    const Overflow overflow;
+    const std::size_t capacity;
+    const clock::time_point epoch = clock::now();
+
+    std::ofstream file;
     std::thread thread;
     std::mutex mutex;
-    std::stringstream stream;
+    std::vector<std::unique_ptr<_impl::LogRing>> rings;
     std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> count_written{0};
 
-public:
-    Log(const std::string & filename) {
-        using namespace std::chrono;
-        const auto time = system_clock::to_time_t(system_clock::now());
-        stream << "# " << std::ctime(&time);
+    static std::uint64_t next_id() {
+        static std::atomic<std::uint64_t> counter{0};
+        return ++counter;
+    }
+
+    _impl::LogRing & attach() {
+        std::lock_guard<std::mutex> lock{mutex};
+        const auto self = std::this_thread::get_id();
+        for (auto & ring : rings) {
+            if (ring->owner == self)
+                return *ring;
+        }
+        rings.emplace_back(new _impl::LogRing{capacity, self});
+        return *rings.back();
+    }
+
+    _impl::LogRing & ring() {
+        thread_local std::uint64_t owner = 0;
+        thread_local _impl::LogRing * cached = nullptr;
+        if (owner != id) {
+            cached = &attach();
+            owner = id;
+        }
+        return *cached;
+    }
+
+    template <class T>
+    void write(const T & t, std::true_type) {
+        (*this)("{}", t);
+    }
+
+    template <class T>
+    void write(const T & t, std::false_type) {
+        std::ostringstream stream;
+        stream << t;
+        (*this)("{}", stream.str());
+    }
 
-        thread = std::thread{[this, filename]
+    // returns the number of records written
+    std::size_t drain(std::vector<_impl::LogRecord> & batch, std::string & text)
+    {
+        batch.clear();
         {
-            std::ofstream file{filename, std::ios::out};
-            if (file.is_open() == false)
-                throw std::runtime_error{"unable to open \"" + filename + "\""};
+            std::lock_guard<std::mutex> lock{mutex};
+            for (auto & ring : rings)
+                ring->drain(batch);
+        }
+        std::stable_sort(batch.begin(), batch.end(),
+            [](const auto & a, const auto & b) { return a.time < b.time; });
 
-            std::string buffer = "";
-            while (running) {
-                std::this_thread::sleep_for(milliseconds(200));
+        text.clear();
+        for (const auto & record : batch)
+            _impl::format(text, record);
+        file << text;
+        count_written += batch.size();
+        return batch.size();
+    }
+
+public:
+    Log(const std::string & filename, const Overflow policy = Overflow::Drop,
+        const std::size_t ring_capacity = 4096)
+        : id(next_id()), overflow(policy), capacity(ring_capacity)
+    {
+        if ((capacity & (capacity - 1)) != 0 || capacity == 0)
+            throw std::invalid_argument{"log capacity must be a power of two"};
 
-                if (stream.fail())
-                    throw std::runtime_error{"stream failbit"};
+        file.open(filename, std::ios::out);
+        if (file.is_open() == false)
+            throw std::runtime_error{"unable to open \"" + filename + "\""};
 
-                else if (file.fail())
-                    throw std::runtime_error{"file failbit"};
+        const auto time = std::chrono::system_clock::to_time_t(
+            std::chrono::system_clock::now());
+        file << "# " << std::ctime(&time);
 
-                else {
-                    std::lock_guard<std::mutex> lock{mutex};
-                    buffer = stream.str();
-                    stream.str("");
-                }
-                file << buffer;
-                buffer = "";
+        thread = std::thread{[this]
+        {
+            std::vector<_impl::LogRecord> batch;
+            std::string text;
+            while (running) {
+                if (drain(batch, text) == 0)
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
             }
-            file.close();
         }};
     }
 
     ~Log() {
         running = false;
         thread.join();
+
+        std::vector<_impl::LogRecord> batch;
+        std::string text;
+        drain(batch, text);
+        file << "# written " << written() << ", dropped " << dropped() << '\n';
+        file.close();
+    }
+
+    // Logs one line, "{}" in the format is replaced by the next argument.
+    template <class... Args>
+    void operator()(const char * format, const Args &... args) {
+        static_assert(sizeof...(Args) <= _impl::LogRecord::max_args,
+                      "too many log arguments");
+        _impl::LogRecord record;
+        record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock::now() - epoch).count();
+        record.format = format;
+        record.argc = sizeof...(Args);
+        const _impl::LogArg array[] = {_impl::LogArg{}, _impl::logarg(args)...};
+        std::copy(array + 1, array + 1 + sizeof...(Args), record.args);
+        record.copy_strings();
+
+        // blocking waits for the writer, which is gone once the log closes
+        auto & r = ring();
+        while (r.push(record) == false) {
+            if (overflow == Overflow::Drop || running == false) {
+                r.dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
+        }
     }
 
-    template<typename T>
+    // Logs t as a line of its own, like the stream based Log did. Types
+    // that a record cannot hold are streamed into text here, on the calling
+    // thread, and cut short like string arguments.
+    template <class T>
     Log & out(const T & t) {
-        std::lock_guard<std::mutex> lock{mutex};
-        stream << t << '\n';
+        write(t, _impl::is_loggable<T>{});
         return *this;
     }
 
-    template<typename T>
-    Log & operator<<(const T & t) {
+    std::uint64_t dropped() {
         std::lock_guard<std::mutex> lock{mutex};
-        stream << t;
-        return *this;
+        std::uint64_t sum = 0;
+        for (auto & ring : rings)
+            sum += ring->dropped.load(std::memory_order_relaxed);
+        return sum;
+    }
+
+    std::uint64_t written() const {
+        return count_written;
     }
 };
 
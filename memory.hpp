@@ -0,0 +1,239 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_MEMORY
+#define CASE_MEMORY
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+
+#ifdef __linux__
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+namespace CASE {
+
+// Allocator policies for the large arrays of the engine. A policy has
+//   static void * allocate(std::size_t bytes, const char *& how);
+//   static void deallocate(void * memory, std::size_t bytes);
+// where how is set to a short description of what was actually done.
+
+struct DefaultAllocator {
+    static void * allocate(const std::size_t bytes, const char *& how) {
+        how = "new";
+        return ::operator new(bytes);
+    }
+
+    static void deallocate(void * memory, const std::size_t) {
+        ::operator delete(memory);
+    }
+};
+
+template <std::size_t ALIGNMENT = 64>
+struct AlignedAllocator {
+    static_assert((ALIGNMENT & (ALIGNMENT - 1)) == 0,
+                  "alignment must be a power of two");
+
+    static void * allocate(const std::size_t bytes, const char *& how) {
+        how = "aligned";
+        void * memory = nullptr;
+        const auto align = ALIGNMENT < sizeof(void *) ? sizeof(void *) : ALIGNMENT;
+        if (posix_memalign(&memory, align, bytes == 0 ? align : bytes) != 0)
+            throw std::bad_alloc{};
+        return memory;
+    }
+
+    static void deallocate(void * memory, const std::size_t) {
+        std::free(memory);
+    }
+};
+
+// 2 MB pages. With EXPLICIT, MAP_HUGETLB is tried first, which needs pages
+// reserved in /proc/sys/vm/nr_hugepages. Otherwise, or when that fails,
+// the memory is 2 MB aligned and advised for transparent huge pages.
+template <bool EXPLICIT = false>
+struct HugePageAllocator {
+    static constexpr std::size_t huge = std::size_t{2} << 20;
+
+    static std::size_t round(const std::size_t bytes) {
+        return (bytes + huge - 1) & ~(huge - 1);
+    }
+
+    static void * allocate(const std::size_t bytes, const char *& how) {
+#ifdef __linux__
+        const auto size = round(bytes == 0 ? 1 : bytes);
+        const auto protection = PROT_READ | PROT_WRITE;
+        const auto flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+        if (EXPLICIT) {
+            const auto memory = mmap(nullptr, size, protection,
+                                     flags | MAP_HUGETLB, -1, 0);
+            if (memory != MAP_FAILED) {
+                how = "hugetlb";
+                return memory;
+            }
+        }
+#endif
+        // over-map by one huge page and trim, to get a 2 MB aligned range
+        const auto raw = mmap(nullptr, size + huge, protection, flags, -1, 0);
+        if (raw == MAP_FAILED)
+            throw std::bad_alloc{};
+        const auto start = reinterpret_cast<std::uintptr_t>(raw);
+        const auto aligned = (start + huge - 1) & ~(huge - 1);
+        if (aligned > start)
+            munmap(raw, aligned - start);
+        const auto tail = start + size + huge - (aligned + size);
+        if (tail > 0)
+            munmap(reinterpret_cast<void *>(aligned + size), tail);
+
+        const auto memory = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+        how = madvise(memory, size, MADV_HUGEPAGE) == 0
+            ? (EXPLICIT ? "thp (hugetlb failed)" : "thp") : "mmap";
+#else
+        how = "mmap";
+#endif
+        return memory;
+#else
+        return AlignedAllocator<huge>::allocate(bytes, how);
+#endif
+    }
+
+    static void deallocate(void * memory, const std::size_t bytes) {
+#ifdef __linux__
+        munmap(memory, round(bytes == 0 ? 1 : bytes));
+#else
+        AlignedAllocator<huge>::deallocate(memory, bytes);
+#endif
+    }
+};
+
+// Memory mapped from an unlinked file in $CASE_MAP_DIR (default /tmp), for
+// worlds larger than RAM. The page cache holds what fits and the kernel
+// writes the rest back to the file, see prefetch() and evict().
+struct MappedAllocator {
+    static void * allocate(const std::size_t bytes, const char *& how) {
+#ifdef __linux__
+        const auto dir = std::getenv("CASE_MAP_DIR");
+        std::string path = dir != nullptr && *dir != '\0' ? dir : "/tmp";
+        path += "/case-XXXXXX";
+        const auto fd = mkstemp(&path[0]);
+        if (fd < 0)
+            throw std::bad_alloc{};
+        unlink(path.c_str());
+        const auto size = bytes == 0 ? 1 : bytes;
+        if (ftruncate(fd, size) != 0) {
+            close(fd);
+            throw std::bad_alloc{};
+        }
+        const auto memory = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, fd, 0);
+        close(fd);
+        if (memory == MAP_FAILED)
+            throw std::bad_alloc{};
+        how = "mapped";
+        return memory;
+#else
+        return DefaultAllocator::allocate(bytes, how);
+#endif
+    }
+
+    static void deallocate(void * memory, const std::size_t bytes) {
+#ifdef __linux__
+        munmap(memory, bytes == 0 ? 1 : bytes);
+#else
+        DefaultAllocator::deallocate(memory, bytes);
+#endif
+    }
+};
+
+namespace _impl {
+#ifdef __linux__
+inline void advise(const void * memory, const std::size_t bytes, const int advice) {
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    const auto first = reinterpret_cast<std::uintptr_t>(memory) & ~(page - 1);
+    const auto last = reinterpret_cast<std::uintptr_t>(memory) + bytes;
+    if (last > first)
+        madvise(reinterpret_cast<void *>(first), last - first, advice);
+}
+#endif
+} // _impl
+
+// Hints that [memory, memory + bytes) is about to be read.
+inline void prefetch(const void * memory, const std::size_t bytes) {
+#ifdef __linux__
+    _impl::advise(memory, bytes, MADV_WILLNEED);
+#endif
+}
+
+// Drops the range from the page tables of this process. On a shared file
+// mapping the pages stay in the page cache, dirty or not, and are only
+// written back and reclaimed by the kernel when it needs the memory, so
+// this bounds the process's resident set rather than the page cache. Only
+// safe for file backed memory, anonymous memory reads back as zeros.
+inline void evict(const void * memory, const std::size_t bytes) {
+#ifdef __linux__
+    _impl::advise(memory, bytes, MADV_DONTNEED);
+#endif
+}
+
+// The policy used by Static(), AgentManager and Grid. Define CASE_ALLOCATOR
+// to a policy type, or one of CASE_MAPPED, CASE_HUGETLB, CASE_HUGEPAGES or
+// CASE_ALIGNED.
+#if defined(CASE_ALLOCATOR)
+using Allocator = CASE_ALLOCATOR;
+#elif defined(CASE_MAPPED)
+using Allocator = MappedAllocator;
+#elif defined(CASE_HUGETLB)
+using Allocator = HugePageAllocator<true>;
+#elif defined(CASE_HUGEPAGES)
+using Allocator = HugePageAllocator<false>;
+#elif defined(CASE_ALIGNED)
+using Allocator = AlignedAllocator<64>;
+#else
+using Allocator = DefaultAllocator;
+#endif
+
+// Allocates count objects, default constructed unless construct is false.
+// With CASE_PROFILE the allocation is reported on stderr.
+template <class T, class Policy = Allocator>
+T * allocate(const std::size_t count, const char * label,
+             const bool construct = true)
+{
+    const char * how = "";
+    const auto bytes = sizeof(T) * count;
+    auto memory = static_cast<T *>(Policy::allocate(bytes, how));
+    if (construct) {
+        for (std::size_t i = 0; i < count; i++)
+            new (memory + i) T;
+    }
+#ifdef CASE_PROFILE
+    std::fprintf(stderr, "%s: %zu x %zu bytes = %.1f MB (%s)\n", label,
+                 count, sizeof(T), bytes / 1e6, how);
+#else
+    (void)label;
+#endif
+    return memory;
+}
+
+template <class T, class Policy = Allocator>
+void deallocate(T * memory, const std::size_t count) {
+    if (memory == nullptr)
+        return;
+    if (std::is_trivially_destructible<T>::value == false) {
+        for (std::size_t i = 0; i < count; i++)
+            memory[i].~T();
+    }
+    Policy::deallocate(memory, sizeof(T) * count);
+}
+
+} // CASE
+
+#endif // CASE_MEMORY
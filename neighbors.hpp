@@ -6,12 +6,34 @@
 
 #include <array>
 #include <cassert>
+#include <type_traits>
 
 #include "index.hpp"
 
 namespace CASE {
 
+// Finds the cell at offset (x, y) from self in grid, for cells that are not
+// one flat array. ChunkedGrid sets one in the AgentManager of its cells,
+// which hand it to Adjacent through Cell::locator().
+struct Locator {
+    void * grid = nullptr;
+    void * (*locate)(void * grid, void * self, int x, int y) = nullptr;
+};
+
+// true if the cell declares chunked = true, see ChunkedZCell. Its
+// neighbours are then found through its locator() instead of by index
+// arithmetic, which is decided at compile time.
+template <class Cell, class = void>
+struct is_chunked : std::false_type {};
+
 template <class Cell>
+struct is_chunked<Cell, decltype(void(Cell::chunked))>
+    : std::integral_constant<bool, Cell::chunked> {};
+
+// C and R fix the columns and rows of the world at compile time, for agents
+// that are only ever run at that size. Left at 0, the size is the one the
+// engine sets in columns and rows before the run.
+template <class Cell, int C = 0, int R = 0>
 class CAdjacent {
     const Cell * self = nullptr;
 
@@ -28,24 +50,26 @@ public:
 
     const Cell & operator()(const int x, const int y) const {
         assert(self != nullptr);
-        assert(columns != 0 && rows != 0);
-
-        const int i = self->index;
-        const int gx = (i % columns) + x;
-        const int gy = (i / columns) + y;
-        return *(self - i + index(wrap(gx, columns), wrap(gy, rows), columns));
+        const _impl::Extent<C> c{columns};
+        const _impl::Extent<R> r{rows};
+        assert(c() != 0 && r() != 0);
+
+        const auto i = self->index;
+        const auto gx = (i % c()) + x;
+        const auto gy = (i / c()) + y;
+        return *(self - i + index(c.wrap(gx), r.wrap(gy), c()));
     }
 
     static int columns;
     static int rows;
 };
 
-template <class T>
-int CAdjacent<T>::columns = 0;
-template <class T>
-int CAdjacent<T>::rows = 0;
+template <class T, int C, int R>
+int CAdjacent<T, C, R>::columns = C;
+template <class T, int C, int R>
+int CAdjacent<T, C, R>::rows = R;
 
-template <class Cell>
+template <class Cell, int C = 0, int R = 0>
 class Adjacent {
     int columns = 0, rows = 0;
     Cell * self = nullptr;
@@ -60,16 +84,29 @@ public:
 
     Cell & operator()(const int x, const int y) {
         assert(self != nullptr);
+        return find(x, y, is_chunked<Cell>{});
+    }
 
-        const int i = self->index;
-        const int gx = (i % columns) + x;
-        const int gy = (i / columns) + y;
-        const auto offset = index(wrap(gx, columns), wrap(gy, rows), columns);
+private:
+    Cell & find(const int x, const int y, std::true_type) {
+        const auto locator = self->locator();
+        assert(locator != nullptr);
+        return *static_cast<Cell *>(locator->locate(locator->grid, self, x, y));
+    }
+
+    Cell & find(const int x, const int y, std::false_type) {
+        const _impl::Extent<C> c{columns};
+        const _impl::Extent<R> r{rows};
+        const auto i = self->index;
+        const auto gx = (i % c()) + x;
+        const auto gy = (i / c()) + y;
+        const auto offset = index(c.wrap(gx), r.wrap(gy), c());
         return *(self - i + offset);
     }
 };
 
-template <class Cell>
+// See CAdjacent for C and R.
+template <class Cell, int C = 0, int R = 0>
 class Neighbors {
 
     inline int index(const int x, const int y) const {
@@ -78,7 +115,7 @@ class Neighbors {
         return 3 * y + x + 4;
     }
 
-    Adjacent<Cell> adjacent;
+    Adjacent<Cell, C, R> adjacent;
     
 public:
     Neighbors(Cell * cell) : adjacent{cell, columns, rows}
@@ -115,10 +152,10 @@ public:
     static int rows;
 };
 
-template <class T>
-int Neighbors<T>::columns = 0;
-template <class T>
-int Neighbors<T>::rows = 0;
+template <class T, int C, int R>
+int Neighbors<T, C, R>::columns = C;
+template <class T, int C, int R>
+int Neighbors<T, C, R>::rows = R;
 
 } // CASE
 
@@ -0,0 +1,167 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_NUMA_TOPOLOGY
+#define CASE_NUMA_TOPOLOGY
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace CASE {
+
+// "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+inline std::vector<int> parse_cpulist(const std::string & list) {
+    std::vector<int> cpus;
+    std::stringstream stream{list};
+    std::string range;
+    while (std::getline(stream, range, ',')) {
+        if (range.empty())
+            continue;
+        const auto dash = range.find('-');
+        const auto first = std::atoi(range.c_str());
+        const auto last = dash == std::string::npos
+            ? first : std::atoi(range.c_str() + dash + 1);
+        for (auto cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// cpus of each NUMA node, a single node holding every cpu if the topology
+// cannot be read
+inline std::vector<std::vector<int>> numa_topology() {
+    std::vector<std::vector<int>> nodes;
+    for (auto node = 0; ; node++) {
+        std::ifstream file{"/sys/devices/system/node/node"
+                           + std::to_string(node) + "/cpulist"};
+        std::string list;
+        if (!file.is_open() || !std::getline(file, list))
+            break;
+        nodes.push_back(parse_cpulist(list));
+    }
+    if (nodes.empty()) {
+        nodes.emplace_back();
+        const int count = std::max<int>(std::thread::hardware_concurrency(), 1);
+        for (auto cpu = 0; cpu < count; cpu++)
+            nodes.back().push_back(cpu);
+    }
+    return nodes;
+}
+
+// The cpu each worker is pinned to, from $CASE_AFFINITY:
+//   compact   fill node 0 first, then node 1, ...
+//   scatter   round robin over the nodes
+//   0,2,4-7   explicit cpu list, worker i gets the i:th entry
+// Empty when unset or "none", i.e. workers are not pinned.
+inline std::vector<int> affinity_layout(const char * fallback = "none") {
+    const auto env = std::getenv("CASE_AFFINITY");
+    const std::string layout = env != nullptr ? env : fallback;
+    const auto nodes = numa_topology();
+
+    std::vector<int> cpus;
+    if (layout == "compact") {
+        for (const auto & node : nodes)
+            cpus.insert(cpus.end(), node.begin(), node.end());
+    }
+    else if (layout == "scatter") {
+        for (auto i = 0u; ; i++) {
+            auto added = false;
+            for (const auto & node : nodes) {
+                if (i < node.size()) {
+                    cpus.push_back(node[i]);
+                    added = true;
+                }
+            }
+            if (added == false)
+                break;
+        }
+    }
+    else if (layout != "none")
+        cpus = parse_cpulist(layout);
+    return cpus;
+}
+
+inline bool pin_thread(std::thread & thread, const int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof set, &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Prints which NUMA node the pages of [memory, memory + bytes) are on.
+// Pages not yet touched are counted as absent.
+inline void numa_report(std::ostream & out, const char * label,
+                        const void * memory, const std::size_t bytes)
+{
+#if defined(__linux__) && defined(SYS_move_pages)
+    const std::size_t page = sysconf(_SC_PAGESIZE);
+    const auto first = reinterpret_cast<std::uintptr_t>(memory) & ~(page - 1);
+    const auto last = reinterpret_cast<std::uintptr_t>(memory) + bytes;
+    const std::size_t total = (last - first + page - 1) / page;
+    const std::size_t step = std::max<std::size_t>(total / 65536, 1);
+
+    std::vector<void *> pages;
+    for (auto p = first; p < last; p += page * step)
+        pages.push_back(reinterpret_cast<void *>(p));
+    std::vector<int> status(pages.size(), -1);
+
+    if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nullptr,
+                status.data(), 0) != 0)
+    {
+        out << label << ": page placement unavailable\n";
+        return;
+    }
+
+    std::vector<std::size_t> per_node;
+    std::size_t absent = 0;
+    for (const auto node : status) {
+        if (node < 0) {
+            absent++;
+            continue;
+        }
+        if (per_node.size() <= std::size_t(node))
+            per_node.resize(node + 1, 0);
+        per_node[node]++;
+    }
+
+    char line[96];
+    std::snprintf(line, sizeof line, "%s: %.1f MB,", label, bytes / 1e6);
+    out << line;
+    for (auto node = 0u; node < per_node.size(); node++) {
+        std::snprintf(line, sizeof line, " node%u %.1f%%", node,
+                      100.0 * per_node[node] / pages.size());
+        out << line;
+    }
+    if (absent > 0) {
+        std::snprintf(line, sizeof line, " untouched %.1f%%",
+                      100.0 * absent / pages.size());
+        out << line;
+    }
+    out << '\n';
+#else
+    out << label << ": page placement unavailable\n";
+#endif
+}
+
+} // CASE
+
+#endif // CASE_NUMA_TOPOLOGY
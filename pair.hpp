@@ -21,6 +21,10 @@ public:
         return flipbit ? a : b;
     }
 
+    inline const T & current() const {
+        return flipbit ? a : b;
+    }
+
     void current(const T & t) {
         flipbit ? a = t : b = t;
     }
@@ -29,6 +33,10 @@ public:
         return flipbit ? b : a;
     }
 
+    inline const T & next() const {
+        return flipbit ? b : a;
+    }
+
     void next(const T & t) {
         flipbit ? b = t : a = t;
     }
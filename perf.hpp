@@ -0,0 +1,290 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_PERF_COUNTERS
+#define CASE_PERF_COUNTERS
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+namespace CASE {
+
+// A snapshot of the hardware counters of the calling thread. Counters that
+// could not be opened read as zero and are left out of reports.
+struct PerfSample {
+    enum Counter { Cycles, Instructions, CacheMisses, BranchMisses, Count };
+    std::uint64_t ns = 0;
+    std::uint64_t values[Count] = {0, 0, 0, 0};
+
+    PerfSample & operator-=(const PerfSample & other) {
+        ns -= other.ns;
+        for (auto i = 0; i < Count; i++)
+            values[i] -= other.values[i];
+        return *this;
+    }
+
+    PerfSample & operator+=(const PerfSample & other) {
+        ns += other.ns;
+        for (auto i = 0; i < Count; i++)
+            values[i] += other.values[i];
+        return *this;
+    }
+};
+
+namespace _impl {
+
+// One perf_event_open group per thread, counting the user space time of
+// that thread only, which perf_event_paranoid 2, the usual default, allows.
+class PerfCounters {
+    int fds[PerfSample::Count] = {-1, -1, -1, -1};
+    int order[PerfSample::Count]; // group position -> counter
+    int opened = 0;
+
+public:
+    int error = 0;
+
+    PerfCounters() {
+#ifdef __linux__
+        static const std::uint64_t configs[PerfSample::Count] = {
+            PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+        };
+        for (auto i = 0; i < PerfSample::Count; i++) {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof attr);
+            attr.size = sizeof attr;
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.disabled = opened == 0;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+
+            const auto leader = opened == 0 ? -1 : fds[order[0]];
+            const int fd = syscall(SYS_perf_event_open, &attr, 0, -1, leader, 0);
+            if (fd < 0) {
+                if (opened == 0) {
+                    error = errno;
+                    return;
+                }
+                continue;
+            }
+            fds[i] = fd;
+            order[opened++] = i;
+        }
+        ioctl(fds[order[0]], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(fds[order[0]], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#else
+        error = ENOSYS;
+#endif
+    }
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (const auto fd : fds) {
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+    }
+
+    bool available() const { return opened > 0; }
+
+    void read(PerfSample & sample) const {
+#ifdef __linux__
+        if (opened == 0)
+            return;
+        std::uint64_t buffer[1 + PerfSample::Count];
+        const auto bytes = ::read(fds[order[0]], buffer, sizeof buffer);
+        if (bytes < static_cast<long>(sizeof(std::uint64_t)))
+            return;
+        for (std::uint64_t i = 0; i < buffer[0] && i < std::uint64_t(opened); i++)
+            sample.values[order[i]] = buffer[1 + i];
+#endif
+    }
+};
+
+struct PerfThread {
+    static constexpr int max_slots = 16;
+    // held by its thread while it records, and by report(), which can run
+    // mid-run from the P key while the workers are recording
+    std::mutex mutex;
+    std::string name;
+    PerfCounters counters;
+    PerfSample totals[max_slots];
+    std::uint64_t calls[max_slots] = {0};
+};
+
+class PerfRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<PerfThread>> threads;
+
+public:
+    std::atomic<const char *> labels[PerfThread::max_slots] = {};
+    std::atomic<const char *> unit{"unit"};
+    std::atomic<std::uint64_t> units{0};
+
+    static PerfRegistry & get() {
+        static PerfRegistry registry;
+        return registry;
+    }
+
+    PerfThread & local() {
+        thread_local PerfThread * thread = nullptr;
+        if (thread == nullptr) {
+            std::lock_guard<std::mutex> lock{mutex};
+            threads.emplace_back(new PerfThread);
+            thread = threads.back().get();
+            thread->name = "thread " + std::to_string(threads.size());
+        }
+        return *thread;
+    }
+
+    void report(std::ostream & out) {
+        std::lock_guard<std::mutex> lock{mutex};
+        if (threads.empty())
+            return;
+
+        const auto & probe = *threads.front();
+        const auto hardware = probe.counters.available();
+        if (hardware == false) {
+            out << "perf counters unavailable ("
+                << std::strerror(probe.counters.error) << "), timing only\n";
+        }
+
+        char line[160];
+        std::snprintf(line, sizeof line,
+                      hardware ? "%-12s %-15s %8s %10s %14s %14s %5s %12s %12s\n"
+                               : "%-12s %-15s %8s %10s\n",
+                      "thread", "phase", "calls", "ms", "cycles",
+                      "instructions", "IPC", "llc-misses", "br-misses");
+        out << line;
+
+        PerfSample sums[PerfThread::max_slots];
+        for (const auto & t : threads) {
+            std::lock_guard<std::mutex> hold{t->mutex};
+            for (auto slot = 0; slot < PerfThread::max_slots; slot++) {
+                if (t->calls[slot] == 0)
+                    continue;
+                const auto & s = t->totals[slot];
+                sums[slot] += s;
+                const auto cycles = s.values[PerfSample::Cycles];
+                const auto ipc = cycles == 0 ? 0.0
+                    : double(s.values[PerfSample::Instructions]) / cycles;
+                std::snprintf(line, sizeof line, hardware
+                    ? "%-12s %-15s %8llu %10.2f %14llu %14llu %5.2f %12llu %12llu\n"
+                    : "%-12s %-15s %8llu %10.2f\n",
+                    t->name.c_str(), labels[slot].load(),
+                    static_cast<unsigned long long>(t->calls[slot]), s.ns / 1e6,
+                    static_cast<unsigned long long>(cycles),
+                    static_cast<unsigned long long>(
+                        s.values[PerfSample::Instructions]), ipc,
+                    static_cast<unsigned long long>(
+                        s.values[PerfSample::CacheMisses]),
+                    static_cast<unsigned long long>(
+                        s.values[PerfSample::BranchMisses]));
+                out << line;
+            }
+        }
+
+        const auto n = units.load();
+        if (n == 0)
+            return;
+        out << "per " << unit.load() << " (" << n << " updates)\n";
+        std::snprintf(line, sizeof line, hardware
+                      ? "%-15s %10s %10s %10s %10s %10s\n" : "%-15s %10s\n",
+                      "phase", "ns", "cycles", "instr", "llc-miss", "br-miss");
+        out << line;
+        for (auto slot = 0; slot < PerfThread::max_slots; slot++) {
+            if (labels[slot] == nullptr || sums[slot].ns == 0)
+                continue;
+            const auto & s = sums[slot];
+            std::snprintf(line, sizeof line, hardware
+                          ? "%-15s %10.3f %10.3f %10.3f %10.4f %10.4f\n"
+                          : "%-15s %10.3f\n",
+                          labels[slot].load(), double(s.ns) / n,
+                          double(s.values[PerfSample::Cycles]) / n,
+                          double(s.values[PerfSample::Instructions]) / n,
+                          double(s.values[PerfSample::CacheMisses]) / n,
+                          double(s.values[PerfSample::BranchMisses]) / n);
+            out << line;
+        }
+    }
+};
+
+} // _impl
+
+// Current counters of the calling thread, opening them on first use.
+inline PerfSample perf_sample() {
+    PerfSample sample;
+#ifdef CASE_PERF
+    _impl::PerfRegistry::get().local().counters.read(sample);
+    sample.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    return sample;
+}
+
+// Attributes the counters accumulated since begin to a slot of the calling
+// thread. Slots are small integers, label must be a literal.
+inline void perf_record(const int slot, const char * label,
+                        const PerfSample & begin)
+{
+#ifdef CASE_PERF
+    auto delta = perf_sample();
+    delta -= begin;
+    auto & registry = _impl::PerfRegistry::get();
+    auto & thread = registry.local();
+    std::lock_guard<std::mutex> lock{thread.mutex};
+    thread.totals[slot] += delta;
+    thread.calls[slot]++;
+    registry.labels[slot] = label;
+#endif
+}
+
+// Counts cells or agents updated, for the per unit report.
+inline void perf_units(const std::uint64_t n, const char * unit) {
+#ifdef CASE_PERF
+    auto & registry = _impl::PerfRegistry::get();
+    registry.units += n;
+    registry.unit = unit;
+#endif
+}
+
+// Names the calling thread in the report, n is appended if not negative.
+inline void perf_thread_name(const char * name, const int n = -1) {
+#ifdef CASE_PERF
+    std::string s = name;
+    if (n >= 0)
+        s += " " + std::to_string(n);
+    auto & thread = _impl::PerfRegistry::get().local();
+    std::lock_guard<std::mutex> lock{thread.mutex};
+    thread.name = s;
+#endif
+}
+
+inline void perf_report(std::ostream & out) {
+#ifdef CASE_PERF
+    _impl::PerfRegistry::get().report(out);
+#endif
+}
+
+} // CASE
+
+#endif // CASE_PERF_COUNTERS
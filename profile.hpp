@@ -0,0 +1,193 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_PROFILER
+#define CASE_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "trace.hpp"
+#include "perf.hpp"
+
+namespace CASE {
+
+// Log-linear (HDR style) histogram of nanosecond samples. Values are kept
+// with a relative error below 1/32, recording is a single relaxed atomic
+// increment so any thread may record at any time.
+class Histogram {
+    static constexpr int sub_bits = 6;
+    static constexpr int half = 1 << (sub_bits - 1);
+    static constexpr int bucket_count = (66 - sub_bits) * half;
+
+    std::atomic<std::uint64_t> buckets[bucket_count];
+    std::atomic<std::uint64_t> total{0};
+    std::atomic<std::uint64_t> sum{0};
+    std::atomic<std::uint64_t> maximum{0};
+
+    static int bucket(const std::uint64_t value) {
+        if (value < 2 * half)
+            return static_cast<int>(value);
+        const int magnitude = 63 - __builtin_clzll(value) - sub_bits + 1;
+        return magnitude * half + static_cast<int>(value >> magnitude);
+    }
+
+    // highest value that falls into bucket i
+    static std::uint64_t highest(const int i) {
+        if (i < 2 * half)
+            return i;
+        const int magnitude = i / half - 1;
+        const std::uint64_t sub = i - magnitude * half;
+        return ((sub + 1) << magnitude) - 1;
+    }
+
+public:
+    Histogram() {
+        reset();
+    }
+
+    inline void record(const std::uint64_t ns) {
+        buckets[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+        total.fetch_add(1, std::memory_order_relaxed);
+        sum.fetch_add(ns, std::memory_order_relaxed);
+        auto max = maximum.load(std::memory_order_relaxed);
+        while (ns > max && !maximum.compare_exchange_weak(max, ns,
+                                                std::memory_order_relaxed))
+        {}
+    }
+
+    void reset() {
+        for (auto & b : buckets)
+            b.store(0, std::memory_order_relaxed);
+        total = 0;
+        sum = 0;
+        maximum = 0;
+    }
+
+    std::uint64_t count() const { return total.load(); }
+    std::uint64_t max() const { return maximum.load(); }
+
+    double mean() const {
+        const auto n = count();
+        return n == 0 ? 0.0 : static_cast<double>(sum.load()) / n;
+    }
+
+    // q in [0, 1], e.g. 0.99 for p99
+    std::uint64_t percentile(const double q) const {
+        const auto n = count();
+        if (n == 0)
+            return 0;
+        const auto rank = static_cast<std::uint64_t>(q * (n - 1)) + 1;
+        std::uint64_t seen = 0;
+        for (auto i = 0; i < bucket_count; i++) {
+            seen += buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+                return std::min(highest(i), max());
+        }
+        return max();
+    }
+};
+
+// The phases of a generation that the engine instruments.
+enum class Phase {
+    Generation,     // everything from barrier to launch of the next update
+    Update,         // a worker updating its share of the world
+    Barrier,        // main thread waiting for workers
+    Postprocessing, // config.postprocessing
+    Flip,           // world flip and job launch
+    Vertices,       // vertex generation
+    Display,        // clear, draw and window.display()
+    Shuffle,        // AgentManager index shuffle
+    Exchange,       // halo exchange between processes
+    Count
+};
+
+inline const char * phase_name(const Phase phase) {
+    static const char * names[] = {
+        "generation", "update", "barrier", "postprocessing",
+        "flip", "vertices", "display", "shuffle", "exchange"
+    };
+    return names[static_cast<int>(phase)];
+}
+
+class Profile {
+public:
+    static Histogram & get(const Phase phase) {
+        static Histogram histograms[static_cast<int>(Phase::Count)];
+        return histograms[static_cast<int>(phase)];
+    }
+
+    static void reset() {
+        for (auto i = 0; i < static_cast<int>(Phase::Count); i++)
+            get(static_cast<Phase>(i)).reset();
+    }
+
+    // one line per phase that has samples, times in microseconds
+    static void report(std::ostream & out) {
+        char line[128];
+        std::snprintf(line, sizeof line, "%-15s %10s %10s %10s %10s %10s\n",
+                      "phase", "count", "mean", "p50", "p99", "max");
+        out << line;
+        for (auto i = 0; i < static_cast<int>(Phase::Count); i++) {
+            const auto phase = static_cast<Phase>(i);
+            const auto & h = get(phase);
+            if (h.count() == 0)
+                continue;
+            std::snprintf(line, sizeof line,
+                          "%-15s %10llu %10.1f %10.1f %10.1f %10.1f\n",
+                          phase_name(phase),
+                          static_cast<unsigned long long>(h.count()),
+                          h.mean() / 1e3, h.percentile(0.5) / 1e3,
+                          h.percentile(0.99) / 1e3, h.max() / 1e3);
+            out << line;
+        }
+    }
+};
+
+// Times the enclosing scope into the histogram of a phase, the trace and
+// the hardware counters. Compiles to nothing unless CASE_PROFILE,
+// CASE_TRACE or CASE_PERF is defined.
+class PhaseScope {
+#if defined(CASE_PROFILE) || defined(CASE_TRACE) || defined(CASE_PERF)
+    const Phase phase;
+    const PerfSample counters = perf_sample();
+    const std::uint64_t start = trace_clock();
+
+public:
+    PhaseScope(const Phase p) : phase(p) {}
+
+    ~PhaseScope() {
+        const auto end = trace_clock();
+#ifdef CASE_PROFILE
+        Profile::get(phase).record(end - start);
+#endif
+        trace_event("phase", phase_name(phase), start, end);
+        perf_record(static_cast<int>(phase), phase_name(phase), counters);
+    }
+#else
+public:
+    PhaseScope(const Phase) {}
+#endif
+    PhaseScope(const PhaseScope &) = delete;
+};
+
+inline void profile_report() {
+#ifdef CASE_PROFILE
+    Profile::report(std::cerr);
+#endif
+    perf_report(std::cerr);
+}
+
+// Names the calling thread in traces and counter reports.
+inline void name_thread(const char * name, const int n = -1) {
+    trace_thread_name(name, n);
+    perf_thread_name(name, n);
+}
+
+} // CASE
+
+#endif // CASE_PROFILER
@@ -4,6 +4,9 @@
 #ifndef CASE_QUAD
 #define CASE_QUAD
 
+#include <type_traits>
+#include <utility>
+
 #include <SFML/Graphics.hpp>
 
 namespace CASE {
@@ -72,6 +75,15 @@ inline void quad(const Color & color, sf::Vertex * vs) {
     vs[3].color = color;
 }
 
+// true if a config declares sf::Color color(int state) const, which engines
+// of plain states draw state with
+template <class Config, class = void>
+struct has_state_color : std::false_type {};
+
+template <class Config>
+struct has_state_color<Config, decltype(void(
+    std::declval<const Config &>().color(0)))> : std::true_type {};
+
 } // CASE
 
 #endif // QUAD
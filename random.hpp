@@ -4,6 +4,8 @@
 #ifndef CASE_RAND
 #define CASE_RAND
 
+#include <atomic>
+#include <cstdint>
 #include <limits>
 #include <algorithm>
 #include <random>
@@ -17,9 +19,38 @@ using Engine = std::mt19937;
 using Engine = std::minstd_rand;
 #endif
 
-inline auto seed() {
+namespace _impl {
+// what the random generators of a thread are seeded from while it runs a
+// seeded world, see Ensemble(). Any seed, 0 included, may start it.
+struct SeedStream {
+    std::uint64_t state = 0;
+    bool seeded = false;
+
+    void start(const std::uint64_t seed) {
+        state = seed;
+        seeded = true;
+    }
+
+    void stop() { seeded = false; }
+};
+
+inline SeedStream & seed_stream() {
+    static thread_local SeedStream stream;
+    return stream;
+}
+} // _impl
+
+inline Engine::result_type seed() {
+    auto & stream = _impl::seed_stream();
+    if (stream.seeded) {
+        // splitmix64
+        auto z = (stream.state += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return static_cast<Engine::result_type>(z ^ (z >> 31));
+    }
 #ifdef CASE_DETERMINISTIC
-    static int index = 0;
+    static std::atomic<unsigned int> index{0};
     static const unsigned int seed[] = {
         170077028, 4157006078, 3702102293, 2899679562,
         2279478864, 1429673373, 3938844402, 2349274950
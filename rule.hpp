@@ -0,0 +1,229 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_RULE
+#define CASE_RULE
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace CASE {
+
+// A rule of the Generations family on the Moore neighbourhood. State 0 is
+// dead, 1 is on and 2 .. states - 1 are refractory: an on cell with a
+// neighbour count not in survive starts dying and then passes through the
+// refractory states, ignoring its neighbours, until it is dead again. A dead
+// cell turns on when its count of on neighbours is in born. Bit n of
+// survive and born stands for a count of n.
+struct GenerationsRule {
+    unsigned survive = 0;
+    unsigned born = 0;
+    int states = 2;
+};
+
+// Parses S/B/C notation, as "/2/3" for Brian's Brain or "23/3/2" for Life.
+// The fields may instead be prefixed with S, B and C in any order, as
+// "B3/S23", and C may be left out for two states.
+inline GenerationsRule generations_rule(const std::string & notation) {
+    GenerationsRule rule;
+    const auto fail = [&]() {
+        return std::invalid_argument{"bad Generations rule \"" + notation + "\""};
+    };
+
+    std::vector<std::string> fields{""};
+    for (const auto c : notation) {
+        if (c == '/')
+            fields.emplace_back();
+        else
+            fields.back() += c;
+    }
+    if (fields.size() < 2 || fields.size() > 3)
+        throw fail();
+
+    const char order[] = {'S', 'B', 'C'};
+    bool seen[3] = {false, false, false};
+    for (auto f = 0u; f < fields.size(); f++) {
+        auto field = fields[f];
+        auto kind = order[f];
+        if (field.empty() == false && std::isalpha(field[0])) {
+            kind = std::toupper(field[0]);
+            field.erase(0, 1);
+        }
+        const auto k = std::find(order, order + 3, kind) - order;
+        if (k == 3 || seen[k])
+            throw fail();
+        seen[k] = true;
+        if (field.find_first_not_of("0123456789") != std::string::npos)
+            throw fail();
+
+        if (kind == 'C') {
+            if (field.empty() || field.size() > 3)
+                throw fail();
+            rule.states = std::stoi(field);
+            if (rule.states < 2 || rule.states > 256)
+                throw fail();
+            continue;
+        }
+        auto & counts = kind == 'S' ? rule.survive : rule.born;
+        for (const auto digit : field) {
+            if (digit > '8')
+                throw fail();
+            counts |= 1u << (digit - '0');
+        }
+    }
+    return rule;
+}
+
+// The cells (x, y) around a cell whose states a rule adds up, within
+// radius of it in both directions.
+struct Neighborhood {
+    int radius = 1;
+    std::vector<std::pair<int, int>> offsets;
+
+    bool operator==(const Neighborhood & other) const {
+        return radius == other.radius && offsets == other.offsets;
+    }
+};
+
+// The square of side 2 * radius + 1 around the cell, with the cell itself
+// only if center is set.
+inline Neighborhood moore(const int radius = 1, const bool center = false) {
+    Neighborhood hood;
+    hood.radius = radius;
+    for (auto y = -radius; y <= radius; y++) {
+        for (auto x = -radius; x <= radius; x++) {
+            if (x != 0 || y != 0 || center)
+                hood.offsets.emplace_back(x, y);
+        }
+    }
+    return hood;
+}
+
+// the cells within a manhattan distance of radius
+inline Neighborhood von_neumann(const int radius = 1, const bool center = false)
+{
+    Neighborhood hood;
+    hood.radius = radius;
+    for (auto y = -radius; y <= radius; y++) {
+        for (auto x = -radius; x <= radius; x++) {
+            if (std::abs(x) + std::abs(y) <= radius && (x != 0 || y != 0 || center))
+                hood.offsets.emplace_back(x, y);
+        }
+    }
+    return hood;
+}
+
+// A neighbourhood drawn as rows of '#' for the cells in it and '.' for the
+// rest, centered on the cell, as {"##.", "#.#", ".##"} for the hexagonal one.
+inline Neighborhood neighborhood(const std::vector<std::string> & mask) {
+    const auto side = static_cast<int>(mask.size());
+    if (side % 2 == 0)
+        throw std::invalid_argument{"neighborhood mask must have an odd side"};
+    Neighborhood hood;
+    hood.radius = side / 2;
+    for (auto y = 0; y < side; y++) {
+        if (static_cast<int>(mask[y].size()) != side)
+            throw std::invalid_argument{"neighborhood mask must be square"};
+        for (auto x = 0; x < side; x++) {
+            if (mask[y][x] == '#')
+                hood.offsets.emplace_back(x - hood.radius, y - hood.radius);
+            else if (mask[y][x] != '.')
+                throw std::invalid_argument{"neighborhood mask takes '#' and '.'"};
+        }
+    }
+    return hood;
+}
+
+// A totalistic or outer totalistic rule compiled to a table. The sum of a
+// cell is the sum of weights[state] over its neighbourhood, and its next
+// state is table[state * sums + sum].
+struct TableRule {
+    int states = 2;
+    Neighborhood neighbors;
+    std::vector<std::uint8_t> weights;
+    int sums = 1;
+    std::vector<std::uint8_t> table;
+
+    int operator()(const int state, const int sum) const {
+        return table[std::size_t(state) * sums + sum];
+    }
+
+    bool operator==(const TableRule & other) const {
+        return states == other.states && neighbors == other.neighbors
+            && weights == other.weights && table == other.table;
+    }
+};
+
+// Builds the table of next(state, sum) for every state and reachable sum,
+// with each state weighing as much as its number unless weights are given.
+template <class Next>
+TableRule compile_rule(const int states, const Neighborhood & neighbors,
+                       Next next, std::vector<std::uint8_t> weights = {})
+{
+    if (states < 2 || states > 256)
+        throw std::invalid_argument{"rule states must be within 2 .. 256"};
+    if (weights.empty()) {
+        for (auto s = 0; s < states; s++)
+            weights.push_back(s);
+    }
+    if (static_cast<int>(weights.size()) != states)
+        throw std::invalid_argument{"rule needs one weight per state"};
+
+    TableRule rule;
+    rule.states = states;
+    rule.neighbors = neighbors;
+    rule.weights = std::move(weights);
+    const auto heaviest = *std::max_element(rule.weights.begin(),
+                                            rule.weights.end());
+    rule.sums = heaviest * static_cast<int>(neighbors.offsets.size()) + 1;
+    if (rule.sums > 1 << 16)
+        throw std::invalid_argument{"rule sums must fit in 16 bits"};
+
+    rule.table.resize(std::size_t(states) * rule.sums);
+    for (auto s = 0; s < states; s++) {
+        for (auto n = 0; n < rule.sums; n++) {
+            const int state = next(s, n);
+            if (state < 0 || state >= states)
+                throw std::invalid_argument{"rule gives a state out of range"};
+            rule.table[std::size_t(s) * rule.sums + n] = state;
+        }
+    }
+    return rule;
+}
+
+// A Generations rule, counting the on cells of neighbors, which is the
+// Moore neighbourhood of GenerationsRule unless given.
+inline TableRule compile_rule(const GenerationsRule & generations,
+                              const Neighborhood & neighbors = moore())
+{
+    std::vector<std::uint8_t> weights(generations.states, 0);
+    weights[1] = 1;
+    const auto states = generations.states;
+    return compile_rule(states, neighbors, [&](const int s, const int n) {
+        const auto in = [n](const unsigned counts) {
+            return n < 32 && (counts >> n & 1) != 0;
+        };
+        if (s == 0)
+            return in(generations.born) ? 1 : 0;
+        if (s == 1)
+            return in(generations.survive) ? 1 : states > 2 ? 2 : 0;
+        return s + 1 == states ? 0 : s + 1;
+    }, weights);
+}
+
+// a rule in B/S or S/B/C notation, see generations_rule()
+inline TableRule compile_rule(const std::string & notation,
+                              const Neighborhood & neighbors = moore())
+{
+    return compile_rule(generations_rule(notation), neighbors);
+}
+
+} // CASE
+
+#endif // CASE_RULE
@@ -0,0 +1,421 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_SPARSE_SIM
+#define CASE_SPARSE_SIM
+
+#include <cassert>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "chunk.hpp"
+#include "job.hpp"
+#include "neighbors.hpp"
+#include "timer.hpp"
+#include "events.hpp"
+#include "log.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "stencil.hpp"
+
+namespace CASE {
+
+// The world of Sparse(), an unbounded plane of SIZE x SIZE chunks. A chunk
+// holds both generations with a one cell halo around them, copied from the
+// neighbouring chunks before each update, so a chunk looks like a
+// (SIZE + 2) x (SIZE + 2) torus to CAdjacent and Static() rules run
+// unchanged. Chunks are allocated when live cells reach their border and
+// freed once they have been empty for idle_limit generations.
+template <class Config, int SIZE = 64>
+class SparseWorld {
+public:
+    using Agent = typename Config::Agent;
+    static constexpr int size = SIZE;
+    static constexpr int stride = SIZE + 2;
+    static constexpr int area = stride * stride;
+    static constexpr int idle_limit = 16;
+
+    struct Chunk {
+        Agent generation[2][area];
+        int cx = 0, cy = 0;
+        int idle = 0;
+        bool empty = true;
+        bool dirty = false;
+        // live cells along each edge and corner, indexed by (dy+1)*3 + dx+1
+        bool border[9] = {false};
+    };
+
+    static inline int padded(const int lx, const int ly) {
+        return (ly + 1) * stride + lx + 1;
+    }
+
+private:
+    Config & config;
+    ChunkMap<Chunk> chunks;
+    int parity = 0;
+
+    Chunk * ensure(const int cx, const int cy) {
+        auto chunk = chunks.find(cx, cy);
+        if (chunk != nullptr)
+            return chunk;
+
+        std::unique_ptr<Chunk> fresh{new Chunk};
+        fresh->cx = cx;
+        fresh->cy = cy;
+        for (auto ly = 0; ly < SIZE; ly++) {
+            for (auto lx = 0; lx < SIZE; lx++) {
+                const auto i = padded(lx, ly);
+                auto agent = config.create(
+                    static_cast<long long>(cx) * SIZE + lx,
+                    static_cast<long long>(cy) * SIZE + ly);
+                agent.index = i;
+                fresh->generation[0][i] = agent;
+                fresh->generation[1][i] = agent;
+            }
+        }
+        return chunks.insert(cx, cy, std::move(fresh));
+    }
+
+    // copies the cells next to each edge and corner from the neighbouring
+    // chunks, or blank cells where there is no chunk
+    void fill_halo(Chunk & chunk) {
+        auto agents = chunk.generation[parity];
+        for (auto dy = -1; dy <= 1; dy++) {
+            for (auto dx = -1; dx <= 1; dx++) {
+                if (dx == 0 && dy == 0)
+                    continue;
+                const auto other = chunks.find(chunk.cx + dx, chunk.cy + dy);
+                const auto x0 = dx < 0 ? -1 : dx > 0 ? SIZE : 0;
+                const auto y0 = dy < 0 ? -1 : dy > 0 ? SIZE : 0;
+                const auto w = dx == 0 ? SIZE : 1;
+                const auto h = dy == 0 ? SIZE : 1;
+                for (auto y = y0; y < y0 + h; y++) {
+                    for (auto x = x0; x < x0 + w; x++) {
+                        auto & halo = agents[padded(x, y)];
+                        if (other != nullptr) {
+                            const auto sx = x - dx * SIZE, sy = y - dy * SIZE;
+                            halo = other->generation[parity][padded(sx, sy)];
+                        }
+                        else
+                            halo = config.create(
+                                static_cast<long long>(chunk.cx) * SIZE + x,
+                                static_cast<long long>(chunk.cy) * SIZE + y);
+                    }
+                }
+            }
+        }
+    }
+
+public:
+    SparseWorld(Config & c) : config(c) {}
+
+    SparseWorld(const SparseWorld &) = delete;
+    SparseWorld & operator=(const SparseWorld &) = delete;
+
+    // the cell at x, y in the current generation, allocating its chunk
+    Agent & operator()(const long long x, const long long y) {
+        const auto cx = static_cast<int>(floor_div(x, SIZE));
+        const auto cy = static_cast<int>(floor_div(y, SIZE));
+        auto chunk = ensure(cx, cy);
+        chunk->dirty = true;
+        return chunk->generation[parity][padded(
+            static_cast<int>(x - static_cast<long long>(cx) * SIZE),
+            static_cast<int>(y - static_cast<long long>(cy) * SIZE))];
+    }
+
+    // Records whether one generation of the chunk is empty and which of its
+    // borders hold live cells. Called by the workers for the generation
+    // they computed.
+    static void scan(Chunk & chunk, const Config & config, const int which) {
+        const auto agents = chunk.generation[which];
+        for (auto & b : chunk.border)
+            b = false;
+        chunk.empty = true;
+        for (auto ly = 0; ly < SIZE; ly++) {
+            const auto by = ly == 0 ? 0 : ly == SIZE - 1 ? 2 : 1;
+            for (auto lx = 0; lx < SIZE; lx++) {
+                if (config.empty(agents[padded(lx, ly)]))
+                    continue;
+                chunk.empty = false;
+                const auto bx = lx == 0 ? 0 : lx == SIZE - 1 ? 2 : 1;
+                chunk.border[by * 3 + bx] = true;
+                // a corner cell also touches both of its edges
+                if (bx != 1)
+                    chunk.border[3 + bx] = true;
+                if (by != 1)
+                    chunk.border[by * 3 + 1] = true;
+            }
+        }
+    }
+
+    // Readies the current generation for an update: grows the world where
+    // live cells reach a border, frees chunks that stayed empty and fills
+    // the halos. Returns the chunks to update.
+    std::vector<Chunk *> prepare() {
+        for (auto chunk : chunks.list()) {
+            if (chunk->dirty) {
+                scan(*chunk, config, parity);
+                chunk->dirty = false;
+            }
+        }
+        for (auto chunk : chunks.list()) {
+            chunk->idle = chunk->empty ? chunk->idle + 1 : 0;
+            for (auto dy = -1; dy <= 1; dy++) {
+                for (auto dx = -1; dx <= 1; dx++) {
+                    if ((dx != 0 || dy != 0)
+                        && chunk->border[(dy + 1) * 3 + dx + 1])
+                    {
+                        auto other = ensure(chunk->cx + dx, chunk->cy + dy);
+                        other->idle = 0;
+                    }
+                }
+            }
+        }
+        for (auto chunk : chunks.list()) {
+            if (chunk->idle > idle_limit)
+                chunks.erase(chunk->cx, chunk->cy);
+        }
+
+        auto list = chunks.list();
+        for (auto chunk : list)
+            fill_halo(*chunk);
+        return list;
+    }
+
+    inline int current() const { return parity; }
+    inline void flip() { parity ^= 1; }
+
+    void clear() {
+        chunks.clear();
+        parity = 0;
+    }
+
+    // draws the current generation within [0, columns) x [0, rows)
+    void draw(std::vector<sf::Vertex> & vertices, const long long columns,
+              const long long rows) const
+    {
+        for (const auto chunk : chunks.list()) {
+            const auto x0 = static_cast<long long>(chunk->cx) * SIZE;
+            const auto y0 = static_cast<long long>(chunk->cy) * SIZE;
+            if (x0 + SIZE <= 0 || y0 + SIZE <= 0 || x0 >= columns || y0 >= rows)
+                continue;
+            for (auto ly = 0; ly < SIZE; ly++) {
+                for (auto lx = 0; lx < SIZE; lx++) {
+                    const auto x = x0 + lx, y = y0 + ly;
+                    if (x < 0 || y < 0 || x >= columns || y >= rows)
+                        continue;
+                    const auto i = vertices.size();
+                    vertices.resize(i + 4);
+                    chunk->generation[parity][padded(lx, ly)].draw(&vertices[i]);
+                }
+            }
+        }
+    }
+
+    std::size_t chunk_count() const { return chunks.size(); }
+
+    long long cell_count() const {
+        return static_cast<long long>(chunks.size()) * SIZE * SIZE;
+    }
+};
+
+template <class Config, int SIZE>
+class SparseJob : public Job {
+    using World = SparseWorld<Config, SIZE>;
+    using Chunk = typename World::Chunk;
+
+    const std::vector<Chunk *> * chunks = nullptr;
+    const Config * config = nullptr;
+    int parity = 0;
+
+    // each worker owns one contiguous band of the chunk list
+    void execute() override {
+        const auto count = chunks->size();
+        const auto first = count * nth / n_threads;
+        const auto last = count * (nth + 1) / n_threads;
+        PhaseScope scope{Phase::Update};
+        for (auto c = first; c < last; c++) {
+            auto & chunk = *(*chunks)[c];
+            const auto current = chunk.generation[parity];
+            const auto next = chunk.generation[parity ^ 1];
+            for (auto ly = 0; ly < SIZE; ly++) {
+                const auto i = World::padded(0, ly);
+                update_cells(current, next, i, i + SIZE);
+            }
+            World::scan(chunk, *config, parity ^ 1);
+        }
+    }
+
+    const char * name() const override { return "update"; }
+
+public:
+    using Job::Job;
+
+    void upload(const std::vector<Chunk *> & list, const Config & c,
+                const int current)
+    {
+        wait();
+        chunks = &list;
+        config = &c;
+        parity = current;
+    }
+};
+
+// Like Static(), but on an unbounded plane, see SparseWorld. The config
+// provides, besides what Static() uses,
+//   Agent create(long long x, long long y);   a blank cell at x, y
+//   bool empty(const Agent &) const;          true if a cell is blank
+//   void init(SparseWorld<Config, SIZE> &);
+//   void postprocessing(SparseWorld<Config, SIZE> &);
+// columns and rows only set the window, cells outside it are still updated.
+template <class Config, int SIZE = 64>
+void Sparse() {
+    Config config;
+    name_thread("main");
+    using Agent = typename Config::Agent;
+    using World = SparseWorld<Config, SIZE>;
+    using Chunk = typename World::Chunk;
+    assert(std::is_trivially_copyable<Agent>::value == true);
+    static_assert(stencil_radius<Agent>::value == 1,
+                  "Sparse() chunks have a halo of one cell.");
+
+    World world{config};
+    std::vector<Chunk *> chunks;
+    bool pending = false;
+
+    CAdjacent<Agent>::columns = World::stride;
+    CAdjacent<Agent>::rows = World::stride;
+
+#ifndef CASE_HEADLESS
+    sf::RenderWindow window;
+    const auto win_w = config.columns * config.cell_size;
+    const auto win_h = config.rows * config.cell_size;
+    window.create(sf::VideoMode(win_w, win_h), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+#endif
+
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+
+    std::list<SparseJob<Config, SIZE>> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    // the workers compute the next generation while the current one is
+    // drawn, the chunk map is only changed here while they are idle
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        {
+            PhaseScope scope{Phase::Barrier};
+            for (auto & job : update_jobs)
+                job.wait();
+        }
+        if (pending) {
+            PhaseScope scope{Phase::Flip};
+            world.flip();
+        }
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world);
+            chunks = world.prepare();
+        }
+        perf_units(world.cell_count(), "cell");
+        for (auto & job : update_jobs) {
+            job.upload(chunks, config, world.current());
+            job.launch();
+        }
+        pending = true;
+        return world.cell_count();
+    };
+
+    auto reset = [&]() {
+        for (auto & job : update_jobs) job.wait();
+        world.clear();
+        pending = false;
+        config.init(world);
+    };
+
+#ifdef CASE_HEADLESS
+    reset();
+    headless({config.title, "sparse", "cell", config.columns, config.rows,
+              threads},
+             update,
+             [&]() { for (auto & job : update_jobs) job.wait(); });
+#else
+    auto framerate = config.framerate;
+    std::vector<sf::Vertex> vertices;
+    vertices.reserve(static_cast<std::size_t>(config.columns) * config.rows * 4);
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms, " << world.chunk_count()
+                  << " chunks\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double dt = 0.0;
+    Timer timer;
+
+    reset();
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+
+                update();
+            }
+        }
+
+        {
+            PhaseScope scope{Phase::Vertices};
+            vertices.clear();
+            world.draw(vertices, config.columns, config.rows);
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(vertices.data(), vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+
+    for (auto & job : update_jobs)
+        job.terminate();
+
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_SPARSE_SIM
@@ -4,61 +4,251 @@
 #ifndef CASE_STATIC_SIM
 #define CASE_STATIC_SIM
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <list>
+#include <type_traits>
 #include <vector>
 
 #include <SFML/Graphics.hpp>
 
 #include "job.hpp"
+#include "index.hpp"
 #include "random.hpp"
 #include "pair.hpp"
 #include "timer.hpp"
 #include "events.hpp"
 #include "log.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "memory.hpp"
+#include "stencil.hpp"
+#include "area.hpp"
 
 namespace CASE {
 
-template <class T>
+template <class T, class Index = int>
 class UpdateJob : public Job {
+    static_assert(std::is_signed<Index>::value,
+                  "The index member of an agent must be signed.");
+
+public:
+    // what a launch does: update cells, or one pass of the area table
+    enum class Pass { Update, Rows, Columns };
+
+private:
+    static constexpr std::size_t stream_bytes = std::size_t{8} << 20;
+
     Uniform<> random;
     T * current = nullptr;
     T * next = nullptr;
-    int array_size = 0;
+    Index array_start = 0;
+    Index array_size = 0;
+    bool touch = false;
+
+    int block = 1;                  // generations per launch
+    Tiling tiles;
+    T * scratch = nullptr;          // two tiles, allocated by the worker
+    std::size_t scratch_count = 0;
 
+    Pass pass = Pass::Update;
+    SummedArea<T> * summed = nullptr;
+
+    // each worker owns one contiguous band of the world
     void execute() override {
-        for (auto i = nth; i < array_size; i += n_threads) {
-            next[i] = current[i];
-            current[i].update(next[i]);
+        if (pass != Pass::Update) {
+            PhaseScope scope{Phase::Update};
+            tabulate(has_area<T>{});
+            pass = Pass::Update;
+            return;
+        }
+        if (block > 1 && touch == false) {
+            PhaseScope scope{Phase::Update};
+            return advance(has_stencil<T>{});
+        }
+        const long long count = array_size - array_start;
+        const Index first = array_start + count * nth / n_threads;
+        const Index last = array_start + count * (nth + 1) / n_threads;
+        if (touch) {
+            for (auto i = first; i < last; i++) {
+                new (current + i) T;
+                new (next + i) T;
+            }
+            touch = false;
+            return;
+        }
+        PhaseScope scope{Phase::Update};
+#ifdef CASE_MAPPED
+        // Sweep the band one block at a time, reading ahead a block and
+        // dropping the one behind, so that a world larger than RAM streams
+        // from the page cache instead of thrashing it.
+        const Index block = std::max<Index>(stream_bytes / sizeof(T), 1);
+        for (auto start = first; start < last; start += block) {
+            const auto end = std::min<Index>(start + block, last);
+            if (end < last) {
+                const auto ahead = std::min<Index>(end + block, last) - end;
+                prefetch(current + end, sizeof(T) * ahead);
+                prefetch(next + end, sizeof(T) * ahead);
+            }
+            sweep(start, end);
+            if (start - first >= block) {
+                evict(current + start - block, sizeof(T) * block);
+                evict(next + start - block, sizeof(T) * block);
+            }
         }
+#else
+        sweep(first, last);
+#endif
+    }
+
+    inline void sweep(const Index first, const Index last) {
+        sweep(first, last, has_area<T>{});
     }
 
+    void sweep(const Index first, const Index last, std::false_type) {
+        update_cells(current, next, first, last);
+    }
+
+    void sweep(const Index first, const Index last, std::true_type) {
+        update_area(current, next, first, last, CAdjacent<T>::columns, *summed);
+    }
+
+    // each worker owns one contiguous band of the table's rows or columns
+    void tabulate(std::true_type) {
+        const long long count = pass == Pass::Rows ? summed->padded_rows()
+                                                   : summed->padded_columns();
+        const auto first = static_cast<int>(count * nth / n_threads);
+        const auto last = static_cast<int>(count * (nth + 1) / n_threads);
+        if (pass == Pass::Rows)
+            summed->template sum_rows<Index>(current, first, last);
+        else
+            summed->sum_columns(first, last);
+    }
+
+    void tabulate(std::false_type) {}
+
+    // each worker owns one contiguous run of tiles
+    void advance(std::true_type) {
+        const auto area = tiles.area();
+        if (scratch_count < 2 * area) {
+            const char * how = "";
+            DefaultAllocator::deallocate(scratch, sizeof(T) * scratch_count);
+            scratch_count = 2 * area;
+            scratch = static_cast<T *>(
+                DefaultAllocator::allocate(sizeof(T) * scratch_count, how));
+        }
+        const auto count = tiles.count();
+        const auto first = static_cast<long long>(count) * nth / n_threads;
+        const auto last = static_cast<long long>(count) * (nth + 1) / n_threads;
+        for (auto n = first; n < last; n++)
+            advance_tile(current, next, scratch, scratch + area, tiles,
+                         static_cast<int>(n), block);
+    }
+
+    void advance(std::false_type) {}
+
+    const char * name() const override { return "update"; }
+
 public:
     using Job::Job;
 
-    void upload(T * first, T * second, const int count) {
+    ~UpdateJob() {
+        DefaultAllocator::deallocate(scratch, sizeof(T) * scratch_count);
+    }
+
+    // From now on each launch advances the whole world generations
+    // generations, a tile at a time, see Tiling.
+    void temporal(const int generations, const Tiling & t) {
+        wait();
+        block = generations;
+        tiles = t;
+    }
+
+    void upload(T * first, T * second, const Index count) {
+        upload(first, second, 0, count);
+    }
+
+    // updates only cells [from, to) of the world
+    void upload(T * first, T * second, const Index from, const Index to) {
         wait();
         current = first;
         next = second;
-        array_size = count;
+        array_start = from;
+        array_size = to;
+    }
+
+    // Launches one pass of building table from world, see SummedArea.
+    void tabulate(SummedArea<T> & table, T * world, const Pass p) {
+        wait();
+        summed = &table;
+        current = world;
+        pass = p;
+        launch();
+    }
+
+    // Constructs this worker's band of both arrays from the worker thread,
+    // so that first-touch page placement puts the band on its NUMA node.
+    void first_touch(T * first, T * second, const Index count) {
+        upload(first, second, count);
+        touch = true;
+        launch();
     }
 };
 
+#ifdef CASE_DISTRIBUTED
+template <class Config>
+void Distributed();
+#endif
+
+// true if the config declares time_block, see Static()
+template <class Config, class = void>
+struct has_time_block : std::false_type {};
+
+template <class Config>
+struct has_time_block<Config, decltype(void(
+    std::declval<const Config &>().time_block))> : std::true_type {};
+
+namespace _impl {
+template <class Config>
+int time_block(const Config & config, std::true_type) {
+    return config.time_block;
+}
+
+template <class Config>
+int time_block(const Config &, std::false_type) {
+    return 1;
+}
+} // _impl
+
 template<class Config>
 void Static() {
+#ifdef CASE_DISTRIBUTED
+    return Distributed<Config>();
+#endif
     Config config;
+    name_thread("main");
     using Agent = typename Config::Agent;
+    using Index = typename index_type<Agent>::type;
     assert(std::is_trivially_copyable<Agent>::value == true);
 
-    const auto size      = config.columns * config.rows;
-    auto agents          = new Agent[size * 2];
-    auto world           = Pair<Agent *>{agents, agents + size};
-    auto framerate       = config.framerate;
+    const Index size     = static_cast<Index>(config.columns) * config.rows;
+#ifdef CASE_NUMA
+    // constructed by the workers, see UpdateJob::first_touch
+    const bool construct = false;
+#else
+    const bool construct = true;
+#endif
+    // separate allocations, so both generations get the policy's alignment
+    auto world           = Pair<Agent *>{
+                               allocate<Agent>(size, "current", construct),
+                               allocate<Agent>(size, "next", construct)};
 
     CAdjacent<Agent>::columns = config.columns;
     CAdjacent<Agent>::rows = config.rows;
 
+#ifndef CASE_HEADLESS
     // set up SFML
     sf::RenderWindow window;
     const auto win_w = config.columns * config.cell_size;
@@ -66,37 +256,113 @@ void Static() {
     window.create(sf::VideoMode(win_w, win_h), config.title);
     window.setKeyRepeatEnabled(false);
     window.setVerticalSyncEnabled(true);
+#endif
+
+    const int threads = worker_count();
 
-    // set number of threads used by update and graphics, with a minimum of 1
-    const int threads = std::max<int>(std::thread::hardware_concurrency()-1, 1);
+#ifdef CASE_NUMA
+    const auto cpus = affinity_layout("scatter");
+#else
+    const auto cpus = affinity_layout();
+#endif
 
     // initialize update threads
-    std::list<UpdateJob<Agent>> update_jobs;
+    std::list<UpdateJob<Agent, Index>> update_jobs;
     for (auto i = 0; i < threads; i++) {
         update_jobs.emplace_back(i, threads);
         auto & job = update_jobs.back();
         job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
     }
 
-    auto update = [&]() {
+    // With $CASE_TIME_BLOCK or Config::time_block above 1, each update
+    // advances that many generations, tile by tile in cache. This needs a
+    // Stencil agent, and postprocessing and drawing see only the last
+    // generation of each block.
+    const auto block = static_cast<int>(env_int("CASE_TIME_BLOCK",
+        _impl::time_block(config, has_time_block<Config>{})));
+    if (block > 1 && has_stencil<Agent>::value == false)
+        std::cerr << "time_block needs a Stencil agent, ignored" << std::endl;
+    else if (block > 1) {
+        static constexpr std::size_t tile_bytes = std::size_t{256} << 10;
+        const auto tiles = tiling(config.columns, config.rows,
+                                  block * stencil_radius<Agent>::value,
+                                  sizeof(Agent), tile_bytes);
         for (auto & job : update_jobs)
-            job.wait();
-        config.postprocessing(world.current());
+            job.temporal(block, tiles);
+    }
+    const int per_update = has_stencil<Agent>::value ? std::max(block, 1) : 1;
+
+    // Area agents read sums from a table of the generation they update,
+    // built by the workers before each update.
+    SummedArea<Agent> area;
+    if (has_area<Agent>::value)
+        area.resize(config.columns, config.rows);
+    using Pass = typename UpdateJob<Agent, Index>::Pass;
+
+#ifdef CASE_NUMA
+    for (auto & job : update_jobs)
+        job.first_touch(world.current(), world.next(), size);
+    for (auto & job : update_jobs)
+        job.wait();
+    numa_report(std::cerr, "current", world.current(), sizeof(Agent) * size);
+    numa_report(std::cerr, "next", world.next(), sizeof(Agent) * size);
+#endif
+
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(size * per_update, "cell");
+        {
+            PhaseScope scope{Phase::Barrier};
+            for (auto & job : update_jobs)
+                job.wait();
+        }
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world.current());
+        }
+        PhaseScope scope{Phase::Flip};
         world.flip();
+        if (has_area<Agent>::value) {
+            for (const auto pass : {Pass::Rows, Pass::Columns}) {
+                for (auto & job : update_jobs)
+                    job.tabulate(area, world.current(), pass);
+                for (auto & job : update_jobs)
+                    job.wait();
+            }
+        }
         for (auto & job : update_jobs) {
             job.upload(world.current(), world.next(), size);
             job.launch();
         }
     };
 
-    std::vector<sf::Vertex> vertices;
-    vertices.resize(size * 4);
-
     auto reset = [&]() {
         for (auto & job : update_jobs) job.wait();
         config.init(world.next());
     };
 
+#ifdef CASE_HEADLESS
+    reset();
+    Headless run{config.title, "static", "cell", config.columns, config.rows,
+                 threads};
+    run.block = per_update;
+    headless(run,
+             [&]() { update(); return size * per_update; },
+             [&]() { for (auto & job : update_jobs) job.wait(); },
+             [&]() {
+                 // the last generation launched is in next
+                 std::uint64_t sum = 0;
+                 for (Index i = 0; i < size; i++)
+                     sum += draw_hash(world.next()[i]);
+                 return sum;
+             });
+#else
+    auto framerate = config.framerate;
+    std::vector<sf::Vertex> vertices;
+    vertices.resize(size * 4);
+
     auto fast_forward = [&](const auto factor) {
         auto frames = std::pow(10, factor);
         std::cout << "Forwarding " << frames << " frames" << std::endl;
@@ -136,23 +402,35 @@ void Static() {
         }
 
         // render
-        auto & current_agents = world.current();
-        for (auto i = 0; i < size; i++)
-            current_agents[i].draw(&vertices[0] + i * 4);
-        
+        {
+            PhaseScope scope{Phase::Vertices};
+            auto & current_agents = world.current();
+            for (Index i = 0; i < size; i++)
+                current_agents[i].draw(&vertices[0] + i * 4);
+        }
+
         // display
+        PhaseScope scope{Phase::Display};
         window.clear(config.bgcolor);
         window.draw(&vertices[0], vertices.size(), sf::Quads);
         window.display();
     }
+#endif
 
     // terminate update threads
     for (auto & job : update_jobs)
         job.terminate();
 
-    delete [] agents;
+    deallocate(world.current(), size);
+    deallocate(world.next(), size);
+    profile_report();
+    trace_write();
 }
 
 } // CASE
 
+#ifdef CASE_DISTRIBUTED
+#include "distributed_sim.hpp"
+#endif
+
 #endif
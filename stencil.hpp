@@ -0,0 +1,219 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_STENCIL
+#define CASE_STENCIL
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+#include "index.hpp"
+#include "neighbors.hpp"
+
+namespace CASE {
+
+// The cells around one cell of a torus, as RADIUS rows above and below it
+// that the engine moves along the row, so neighbour (x, y) is a load at a
+// fixed offset instead of a division of the cell's index. Static agents
+// opt in with
+//   void update(Agent & next, const Stencil<Agent> & neighbors) const;
+// instead of update(Agent &) and CAdjacent, and a wider neighbourhood with
+//   static constexpr int stencil_radius = 2;
+template <class Cell, int RADIUS = 1>
+class Stencil {
+    static_assert(RADIUS >= 1, "Stencil RADIUS must be >= 1.");
+    static constexpr int width = 2 * RADIUS + 1;
+
+    const Cell * lines[width];
+    int xs[width];
+
+public:
+    static constexpr int radius = RADIUS;
+
+    // moves to row y of a world of columns x rows cells
+    template <class Index>
+    void row(const Cell * world, const Index y, const int columns,
+             const int rows)
+    {
+        assert(rows >= RADIUS && columns >= RADIUS);
+        for (auto k = 0; k < width; k++)
+            lines[k] = world + index(Index(0), wrap(y + k - RADIUS, Index(rows)),
+                                     columns);
+    }
+
+    // moves to column x of the row
+    void column(const int x, const int columns) {
+        for (auto k = 0; k < width; k++) {
+            const auto c = x + k - RADIUS;
+            xs[k] = c < 0 ? c + columns : c >= columns ? c - columns : c;
+        }
+    }
+
+    const Cell & operator()(const int x, const int y) const {
+        assert(x >= -RADIUS && x <= RADIUS);
+        assert(y >= -RADIUS && y <= RADIUS);
+        return lines[y + RADIUS][xs[x + RADIUS]];
+    }
+};
+
+template <class T, class = void>
+struct stencil_radius : std::integral_constant<int, 1> {};
+
+template <class T>
+struct stencil_radius<T, decltype(void(T::stencil_radius))>
+    : std::integral_constant<int, T::stencil_radius> {};
+
+template <class T>
+using stencil_type = Stencil<T, stencil_radius<T>::value>;
+
+// true if T has update(T &, const Stencil<T> &) const
+template <class T, class = void>
+struct has_stencil : std::false_type {};
+
+template <class T>
+struct has_stencil<T, decltype(void(std::declval<const T &>().update(
+    std::declval<T &>(), std::declval<const stencil_type<T> &>())))>
+    : std::true_type {};
+
+namespace _impl {
+template <class Agent, class Index>
+void update_cells(const Agent * current, Agent * next, const Index first,
+                  const Index last, std::false_type)
+{
+    for (auto i = first; i < last; i++) {
+        next[i] = current[i];
+        current[i].update(next[i]);
+    }
+}
+
+template <class Agent, class Index>
+void update_cells(const Agent * current, Agent * next, Index first,
+                  const Index last, std::true_type)
+{
+    const int columns = CAdjacent<Agent>::columns;
+    const int rows = CAdjacent<Agent>::rows;
+    assert(columns != 0 && rows != 0);
+
+    stencil_type<Agent> stencil;
+    while (first < last) {
+        const Index y = first / columns;
+        auto x = static_cast<int>(first % columns);
+        const auto end = std::min(last, index(Index(0), y + 1, columns));
+        stencil.row(current, y, columns, rows);
+        for (; first < end; first++, x++) {
+            stencil.column(x, columns);
+            next[first] = current[first];
+            current[first].update(next[first], stencil);
+        }
+    }
+}
+} // _impl
+
+// A world split into tiles that are advanced several generations at a
+// time. A tile is read with halo_x, halo_y cells of margin, which are
+// updated too, each generation one radius fewer of them correctly, so that
+// the interior is still exact after the last one. Tiles span the whole
+// width when the world is narrow enough, and then need no margin on the
+// sides.
+struct Tiling {
+    int columns = 0, rows = 0;  // of the world
+    int halo_x = 0, halo_y = 0;
+    int width = 0, height = 0;  // of a tile's interior
+    int across = 0, down = 0;
+
+    int count() const { return across * down; }
+    // the cells of a tile with its margin
+    std::size_t area() const {
+        return std::size_t(width + 2 * halo_x) * (height + 2 * halo_y);
+    }
+};
+
+// tiles of about bytes each for cells of cell_bytes
+inline Tiling tiling(const int columns, const int rows, const int halo,
+                     const std::size_t cell_bytes, const std::size_t bytes)
+{
+    Tiling t;
+    t.columns = columns;
+    t.rows = rows;
+    t.halo_y = halo;
+    const long cells = std::max<long>(bytes / cell_bytes, 1);
+    const int side = static_cast<int>(std::sqrt(double(cells)));
+    if (columns <= 2 * side) {
+        t.width = columns;
+        t.height = std::max<long>(cells / columns - 2 * halo, 2 * halo);
+    }
+    else {
+        t.halo_x = halo;
+        t.width = t.height = std::max(side - 2 * halo, 2 * halo);
+    }
+    t.width = std::min(t.width, columns);
+    t.height = std::min(t.height, rows);
+    t.across = (columns + t.width - 1) / t.width;
+    t.down = (rows + t.height - 1) / t.height;
+    return t;
+}
+
+// Advances tile n of world generations generations into out, using a and
+// b of t.area() cells each as scratch.
+template <class Agent>
+void advance_tile(const Agent * world, Agent * out, Agent * a, Agent * b,
+                  const Tiling & t, const int n, const int generations)
+{
+    using Index = typename index_type<Agent>::type;
+    constexpr int r = stencil_radius<Agent>::value;
+    assert(generations * r <= t.halo_y);
+
+    const auto x0 = n % t.across * t.width;
+    const auto y0 = n / t.across * t.height;
+    const auto w = std::min(t.width, t.columns - x0);
+    const auto h = std::min(t.height, t.rows - y0);
+    const auto hx = t.halo_x, hy = t.halo_y;
+    const auto sw = w + 2 * hx, sh = h + 2 * hy;
+
+    for (auto y = 0; y < sh; y++) {
+        const auto line = world + index(Index(0),
+                                        wrap(Index(y0 - hy + y), Index(t.rows)),
+                                        t.columns);
+        for (auto x = 0; x < sw; x++)
+            a[index(x, y, sw)] = line[hx == 0 ? x : wrap(x0 - hx + x, t.columns)];
+    }
+
+    stencil_type<Agent> stencil;
+    for (auto g = 1; g <= generations; g++) {
+        const auto left = hx == 0 ? 0 : g * r;
+        const auto right = hx == 0 ? sw : sw - g * r;
+        for (auto y = g * r; y < sh - g * r; y++) {
+            stencil.row(a, y, sw, sh);
+            for (auto x = left; x < right; x++) {
+                const auto i = index(x, y, sw);
+                stencil.column(x, sw);
+                b[i] = a[i];
+                a[i].update(b[i], stencil);
+            }
+        }
+        std::swap(a, b);
+    }
+
+    for (auto y = 0; y < h; y++) {
+        const auto line = out + index(Index(x0), Index(y0 + y), t.columns);
+        for (auto x = 0; x < w; x++)
+            line[x] = a[index(hx + x, hy + y, sw)];
+    }
+}
+
+// Updates cells [first, last) of a world of CAdjacent<Agent>::columns x
+// rows cells, through the stencil if the agent takes one.
+template <class Agent, class Index>
+void update_cells(const Agent * current, Agent * next, const Index first,
+                  const Index last)
+{
+    _impl::update_cells(current, next, first, last, has_stencil<Agent>{});
+}
+
+} // CASE
+
+#endif // CASE_STENCIL
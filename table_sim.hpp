@@ -0,0 +1,378 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_TABLE_SIM
+#define CASE_TABLE_SIM
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <type_traits>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+#include "job.hpp"
+#include "helper.hpp"
+#include "quad.hpp"
+#include "timer.hpp"
+#include "events.hpp"
+#include "profile.hpp"
+#include "headless.hpp"
+#include "numa.hpp"
+#include "rule.hpp"
+
+namespace CASE {
+
+// The cells of a TableRule on a torus, a byte each, in rows padded with a
+// margin as wide as the rule's radius that repeats the other side of the
+// world. Each row is updated without branches: the neighbourhood's rows
+// are added up into a row of sums, and the sums and states looked up in
+// the rule's table.
+class TableWorld {
+    int columns = 0;
+    int rows = 0;
+    int radius = 0;
+    int stride = 0;
+    TableRule active;
+    bool weighted = false;                      // weights other than states
+    std::vector<std::uint8_t> generation[2];
+    std::vector<std::uint8_t> weights;          // of current, if weighted
+    int parity = 0;
+
+    std::size_t at(const int x, const int y) const {
+        return std::size_t(y + radius) * stride + (x + radius);
+    }
+
+    // lays the world out again for a rule of another radius
+    void pad(const int r) {
+        std::vector<std::uint8_t> cells(std::size_t(columns) * rows);
+        for (auto y = 0; y < rows && stride != 0; y++) {
+            for (auto x = 0; x < columns; x++)
+                cells[std::size_t(y) * columns + x] = (*this)(x, y);
+        }
+        radius = r;
+        stride = columns + 2 * r;
+        for (auto & g : generation)
+            g.assign(std::size_t(stride) * (rows + 2 * r), 0);
+        weights.assign(generation[0].size(), 0);
+        for (auto y = 0; y < rows; y++) {
+            for (auto x = 0; x < columns; x++)
+                generation[parity][at(x, y)] = cells[std::size_t(y) * columns + x];
+        }
+    }
+
+    // copies the wrapped around cells into the margin
+    void halo(std::vector<std::uint8_t> & cells) {
+        for (auto y = 0; y < rows; y++) {
+            for (auto x = 1; x <= radius; x++) {
+                cells[at(-x, y)] = cells[at(wrap(-x, columns), y)];
+                cells[at(columns - 1 + x, y)] = cells[at(wrap(x - 1, columns), y)];
+            }
+        }
+        for (auto y = 1; y <= radius; y++) {
+            std::copy_n(&cells[at(-radius, wrap(-y, rows))], stride,
+                        &cells[at(-radius, -y)]);
+            std::copy_n(&cells[at(-radius, wrap(y - 1, rows))], stride,
+                        &cells[at(-radius, rows - 1 + y)]);
+        }
+    }
+
+public:
+    TableWorld(const int c, const int r, const TableRule & rule)
+        : columns(c), rows(r), active(rule)
+    {
+        assert(columns >= 1 && rows >= 1);
+        pad(rule.neighbors.radius);
+        prepare(rule);
+    }
+
+    int width() const { return columns; }
+    int height() const { return rows; }
+    const TableRule & rule() const { return active; }
+
+    int operator()(const int x, const int y) const {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        return generation[parity][at(x, y)];
+    }
+
+    void set(const int x, const int y, const int state) {
+        assert(x >= 0 && x < columns && y >= 0 && y < rows);
+        assert(state >= 0 && state < active.states);
+        generation[parity][at(x, y)] = state;
+    }
+
+    void clear() {
+        for (auto & g : generation)
+            std::fill(g.begin(), g.end(), 0);
+    }
+
+    // Switches to rule if it has changed, which must keep the number of
+    // states, and fills in the margin of the current generation. Call it
+    // before each step.
+    void prepare(const TableRule & rule) {
+        if ((active == rule) == false) {
+            assert(rule.states == active.states);
+            if (rule.neighbors.radius != radius)
+                pad(rule.neighbors.radius);
+            active = rule;
+        }
+        weighted = false;
+        for (auto s = 0; s < active.states; s++)
+            weighted = weighted || active.weights[s] != s;
+        if (weighted == false)
+            return halo(generation[parity]);
+
+        const auto & cells = generation[parity];
+        for (auto y = 0; y < rows; y++) {
+            for (auto x = 0; x < columns; x++)
+                weights[at(x, y)] = active.weights[cells[at(x, y)]];
+        }
+        halo(weights);
+    }
+
+    // computes rows [first, last) of the next generation, with sums room
+    // for a row of sums
+    void step(const int first, const int last, std::uint16_t * sums) {
+        const auto source = (weighted ? weights : generation[parity]).data();
+        const auto current = generation[parity].data();
+        const auto next = generation[parity ^ 1].data();
+        const auto table = active.table.data();
+        const auto per_state = active.sums;
+
+        for (auto y = first; y < last; y++) {
+            std::fill(sums, sums + columns, 0);
+            for (const auto & offset : active.neighbors.offsets) {
+                const auto line = source + at(offset.first, y + offset.second);
+                for (auto x = 0; x < columns; x++)
+                    sums[x] += line[x];
+            }
+            const auto cells = current + at(0, y);
+            const auto out = next + at(0, y);
+            for (auto x = 0; x < columns; x++)
+                out[x] = table[cells[x] * per_state + sums[x]];
+        }
+    }
+
+    // makes the generation computed by step() the current one
+    void flip() { parity ^= 1; }
+};
+
+class TableJob : public Job {
+    TableWorld * world = nullptr;
+    std::vector<std::uint16_t> sums;
+
+    // each worker owns one contiguous band of rows
+    void execute() override {
+        const long long rows = world->height();
+        sums.resize(world->width());
+        PhaseScope scope{Phase::Update};
+        world->step(static_cast<int>(rows * nth / n_threads),
+                    static_cast<int>(rows * (nth + 1) / n_threads),
+                    sums.data());
+    }
+
+    const char * name() const override { return "update"; }
+
+public:
+    using Job::Job;
+
+    void upload(TableWorld & w) {
+        wait();
+        world = &w;
+    }
+};
+
+namespace _impl {
+template <class Config>
+sf::Color table_color(const Config & config, const int state, const int,
+                      std::true_type)
+{
+    return config.color(state);
+}
+
+// from white for 0 to black for the last state
+template <class Config>
+sf::Color table_color(const Config &, const int state, const int states,
+                      std::false_type)
+{
+    const auto shade = static_cast<std::uint8_t>(255 - 255 * state / (states - 1));
+    return sf::Color{shade, shade, shade};
+}
+} // _impl
+
+// Runs a rule compiled with compile_rule(), see TableWorld. The config
+// provides
+//   int columns, rows, cell_size;
+//   double framerate;
+//   const char * title;
+//   sf::Color bgcolor;
+//   TableRule rule;                       read every generation
+//   void init(TableWorld &);
+//   void postprocessing(TableWorld &);    before each generation
+// and optionally sf::Color color(int state) const for drawing. The rule may
+// change between generations, but not its number of states.
+template <class Config>
+void Table() {
+    Config config;
+    name_thread("main");
+
+    const auto columns = config.columns;
+    const auto rows = config.rows;
+    const auto size = static_cast<long long>(columns) * rows;
+    TableWorld world{columns, rows, config.rule};
+
+#ifndef CASE_HEADLESS
+    sf::RenderWindow window;
+    window.create(sf::VideoMode(columns * config.cell_size,
+                                rows * config.cell_size), config.title);
+    window.setKeyRepeatEnabled(false);
+    window.setVerticalSyncEnabled(true);
+#endif
+
+    const int threads = worker_count();
+    const auto cpus = affinity_layout();
+
+    std::list<TableJob> update_jobs;
+    for (auto i = 0; i < threads; i++) {
+        update_jobs.emplace_back(i, threads);
+        auto & job = update_jobs.back();
+        job.thread = std::thread{[&job]{ job.run(); }};
+        if (cpus.empty() == false)
+            pin_thread(job.thread, cpus[i % cpus.size()]);
+    }
+
+    // the workers write the next generation while the current one is
+    // drawn, which it becomes at the start of the following update
+    bool pending = false;
+    auto update = [&]() {
+        PhaseScope generation{Phase::Generation};
+        perf_units(size, "cell");
+        {
+            PhaseScope scope{Phase::Barrier};
+            for (auto & job : update_jobs)
+                job.wait();
+        }
+        if (pending) {
+            PhaseScope scope{Phase::Flip};
+            world.flip();
+        }
+        {
+            PhaseScope scope{Phase::Postprocessing};
+            config.postprocessing(world);
+            world.prepare(config.rule);
+        }
+        for (auto & job : update_jobs) {
+            job.upload(world);
+            job.launch();
+        }
+        pending = true;
+    };
+
+    auto reset = [&]() {
+        for (auto & job : update_jobs) job.wait();
+        world.clear();
+        pending = false;
+        config.init(world);
+    };
+
+#ifdef CASE_HEADLESS
+    reset();
+    headless({config.title, "table", "cell", columns, rows, threads},
+             [&]() { update(); return size; },
+             [&]() { for (auto & job : update_jobs) job.wait(); },
+             [&]() {
+                 if (pending)
+                     world.flip();
+                 pending = false;
+                 std::uint64_t sum = 0;
+                 for (auto y = 0; y < rows; y++) {
+                     for (auto x = 0; x < columns; x++)
+                         sum += state_hash(std::uint64_t(y) * columns + x,
+                                           world(x, y));
+                 }
+                 return sum;
+             });
+#else
+    std::vector<sf::Color> palette;
+    for (auto s = 0; s < world.rule().states; s++)
+        palette.push_back(_impl::table_color(config, s, world.rule().states,
+                                             has_state_color<Config>{}));
+
+    std::vector<sf::Vertex> vertices(size * 4);
+    for (auto y = 0; y < rows; y++) {
+        for (auto x = 0; x < columns; x++) {
+            quad(x * config.cell_size, y * config.cell_size, config.cell_size,
+                 config.cell_size, &vertices[(std::size_t(y) * columns + x) * 4]);
+        }
+    }
+
+    auto fast_forward = [&](const auto factor) {
+        auto frames = std::pow(10, factor);
+        std::cout << "Forwarding " << frames << " frames" << std::endl;
+        static Timer timer; timer.start();
+        while (frames--)
+            update();
+        std::cout << timer.reset() << "ms\n";
+    };
+
+    bool pause = false;
+    bool running = true;
+    double framerate = config.framerate;
+    double dt = 0.0;
+    Timer timer;
+
+    reset();
+
+    while (running) {
+        bool step = false;
+
+        eventhandling(window, running, pause, step, framerate,
+                      reset, fast_forward);
+        if (pause) {
+            if (step)
+                update();
+            timer.reset();
+            dt = 0.0;
+        }
+        else {
+            const auto frame_time = 1000.0 / framerate;
+            dt += timer.reset();
+            if (dt > frame_time) {
+                dt -= frame_time;
+                update();
+            }
+        }
+
+        // the current generation is only read while the workers run
+        {
+            PhaseScope scope{Phase::Vertices};
+            for (auto y = 0; y < rows; y++) {
+                for (auto x = 0; x < columns; x++) {
+                    const auto & c = palette[world(x, y)];
+                    quad(int(c.r), int(c.g), int(c.b),
+                         &vertices[(std::size_t(y) * columns + x) * 4]);
+                }
+            }
+        }
+
+        PhaseScope scope{Phase::Display};
+        window.clear(config.bgcolor);
+        window.draw(&vertices[0], vertices.size(), sf::Quads);
+        window.display();
+    }
+#endif
+
+    for (auto & job : update_jobs)
+        job.terminate();
+
+    profile_report();
+    trace_write();
+}
+
+} // CASE
+
+#endif // CASE_TABLE_SIM
@@ -0,0 +1,181 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_TRACER
+#define CASE_TRACER
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace CASE {
+
+namespace _impl {
+
+struct TraceEvent {
+    const char * category;
+    const char * name;
+    std::uint64_t begin;    // ns, steady clock
+    std::uint64_t end;
+    int arg;                // job index, or -1
+};
+
+struct TraceBuffer {
+    static constexpr std::size_t max_events = 1 << 20;
+    // held by its thread while it records, and by write(), since threads
+    // such as the shuffle of an AgentManager may still be recording then
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::string thread_name;
+    std::uint64_t dropped = 0;
+    int tid = 0;
+};
+
+class TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+
+public:
+    static TraceRegistry & get() {
+        static TraceRegistry registry;
+        return registry;
+    }
+
+    // The buffer of the calling thread. Buffers are owned by the registry
+    // so that they outlive the worker threads that filled them.
+    TraceBuffer & local() {
+        thread_local TraceBuffer * buffer = nullptr;
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock{mutex};
+            buffers.emplace_back(new TraceBuffer);
+            buffer = buffers.back().get();
+            buffer->tid = static_cast<int>(buffers.size());
+            buffer->thread_name = "thread " + std::to_string(buffer->tid);
+            buffer->events.reserve(1024);
+        }
+        return *buffer;
+    }
+
+    // Writes every buffer as Chrome trace-event JSON, which loads in
+    // chrome://tracing and ui.perfetto.dev. Buffers are cleared.
+    void write(const std::string & filename) {
+        std::lock_guard<std::mutex> lock{mutex};
+        auto file = std::fopen(filename.c_str(), "w");
+        if (file == nullptr)
+            return;
+
+        std::uint64_t epoch = UINT64_MAX;
+        std::vector<std::unique_lock<std::mutex>> held;
+        for (const auto & buffer : buffers) {
+            held.emplace_back(buffer->mutex);
+            for (const auto & e : buffer->events)
+                epoch = std::min(epoch, e.begin);
+        }
+
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        auto first = true;
+        for (const auto & buffer : buffers) {
+            std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+                         "\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                         first ? "" : ",\n", buffer->tid,
+                         buffer->thread_name.c_str());
+            first = false;
+            for (const auto & e : buffer->events) {
+                std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\","
+                             "\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                             "\"pid\":0,\"tid\":%d",
+                             e.name, e.category, (e.begin - epoch) / 1e3,
+                             (e.end - e.begin) / 1e3, buffer->tid);
+                if (e.arg >= 0)
+                    std::fprintf(file, ",\"args\":{\"nth\":%d}", e.arg);
+                std::fprintf(file, "}");
+            }
+            if (buffer->dropped > 0)
+                std::fprintf(stderr, "trace: %s dropped %llu events\n",
+                             buffer->thread_name.c_str(),
+                             static_cast<unsigned long long>(buffer->dropped));
+            buffer->events.clear();
+            buffer->dropped = 0;
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+    }
+};
+
+} // _impl
+
+inline std::uint64_t trace_clock() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+inline void trace_event(const char * category, const char * name,
+                        const std::uint64_t begin, const std::uint64_t end,
+                        const int arg = -1)
+{
+#ifdef CASE_TRACE
+    auto & buffer = _impl::TraceRegistry::get().local();
+    std::lock_guard<std::mutex> lock{buffer.mutex};
+    if (buffer.events.size() < buffer.max_events)
+        buffer.events.push_back({category, name, begin, end, arg});
+    else
+        buffer.dropped++;
+#endif
+}
+
+// Names the calling thread in the trace, n is appended if not negative.
+inline void trace_thread_name(const char * name, const int n = -1) {
+#ifdef CASE_TRACE
+    std::string s = name;
+    if (n >= 0)
+        s += " " + std::to_string(n);
+    auto & buffer = _impl::TraceRegistry::get().local();
+    std::lock_guard<std::mutex> lock{buffer.mutex};
+    buffer.thread_name = s;
+#endif
+}
+
+// Writes the trace to $CASE_TRACE_FILE, or trace.json.
+inline void trace_write() {
+#ifdef CASE_TRACE
+    const auto env = std::getenv("CASE_TRACE_FILE");
+    const std::string filename = env != nullptr ? env : "trace.json";
+    _impl::TraceRegistry::get().write(filename);
+    std::fprintf(stderr, "trace written to %s\n", filename.c_str());
+#endif
+}
+
+// Records the enclosing scope as one complete event. Compiles to nothing
+// unless CASE_TRACE is defined.
+class TraceScope {
+#ifdef CASE_TRACE
+    const char * category;
+    const char * name;
+    const int arg;
+    const std::uint64_t begin = trace_clock();
+
+public:
+    TraceScope(const char * cat, const char * n, const int a = -1)
+        : category(cat), name(n), arg(a)
+    {}
+
+    ~TraceScope() {
+        trace_event(category, name, begin, trace_clock(), arg);
+    }
+#else
+public:
+    TraceScope(const char *, const char *, const int = -1) {}
+#endif
+    TraceScope(const TraceScope &) = delete;
+};
+
+} // CASE
+
+#endif // CASE_TRACER
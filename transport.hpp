@@ -0,0 +1,404 @@
+/* Author: Mikko Finell
+ * License: Public Domain */
+
+#ifndef CASE_TRANSPORT
+#define CASE_TRANSPORT
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#ifdef CASE_MPI
+#include <mpi.h>
+#endif
+
+namespace CASE {
+
+struct Message {
+    int peer;
+    void * data;
+    std::size_t bytes;
+};
+
+// Moves halos between the processes of a distributed run. exchange() sends
+// every message in out, fills every message in in and returns when all of
+// them are done, progressing on whichever peer is ready. Messages between
+// two processes arrive in the order they were sent, so the i:th message
+// sent to a peer fills the i:th entry of in from that sender.
+class Transport {
+public:
+    virtual ~Transport() {}
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+    virtual const char * name() const = 0;
+    virtual void exchange(const std::vector<Message> & out,
+                          const std::vector<Message> & in) = 0;
+};
+
+namespace _impl {
+
+inline void fail(const char * what) {
+    std::perror(what);
+    std::exit(1);
+}
+
+// Progress of the messages of one exchange, the first unfinished message
+// to and from each peer is the only one that may move.
+struct Pending {
+    std::vector<Message> messages;
+    std::vector<std::size_t> done;
+
+    Pending(const std::vector<Message> & m, const int self)
+    {
+        for (const auto & message : m) {
+            if (message.peer != self)
+                messages.push_back(message);
+        }
+        done.assign(messages.size(), 0);
+    }
+
+    // index of the first unfinished message for peer, -1 if none
+    int first(const int peer) const {
+        for (auto i = 0u; i < messages.size(); i++) {
+            if (messages[i].peer == peer && done[i] < messages[i].bytes)
+                return i;
+        }
+        return -1;
+    }
+
+    bool finished() const {
+        for (auto i = 0u; i < messages.size(); i++) {
+            if (done[i] < messages[i].bytes)
+                return false;
+        }
+        return true;
+    }
+};
+
+// messages a process sends to itself are copied in order
+inline void deliver_local(const int self, const std::vector<Message> & out,
+                          const std::vector<Message> & in)
+{
+    auto next = in.begin();
+    for (const auto & message : out) {
+        if (message.peer != self)
+            continue;
+        while (next != in.end() && next->peer != self)
+            ++next;
+        assert(next != in.end() && next->bytes == message.bytes);
+        std::memcpy(next->data, message.data, message.bytes);
+        ++next;
+    }
+}
+
+} // _impl
+
+// Processes forked on this host. Rank 0 is the calling process and waits
+// for the others when the transport is destroyed.
+class LocalTransport : public Transport {
+    std::vector<pid_t> children;
+
+protected:
+    int self = 0;
+    int count = 1;
+
+    // forks count - 1 children, the caller sets up the channels before
+    void fork_group(const int processes) {
+        count = processes;
+        for (auto r = 1; r < count; r++) {
+            const auto pid = fork();
+            if (pid < 0)
+                _impl::fail("fork");
+            if (pid == 0) {
+                children.clear();
+                self = r;
+                return;
+            }
+            children.push_back(pid);
+        }
+    }
+
+public:
+    ~LocalTransport() {
+        for (const auto pid : children) {
+            int status = 0;
+            waitpid(pid, &status, 0);
+        }
+    }
+
+    int rank() const override { return self; }
+    int size() const override { return count; }
+};
+
+// Unix socket pairs between every two processes.
+class SocketTransport : public LocalTransport {
+    std::vector<int> sockets;  // by peer, -1 for self
+
+public:
+    SocketTransport(const int processes) {
+        // fds[i * processes + j] is the end process i uses to talk to j
+        std::vector<int> fds(processes * processes, -1);
+        for (auto i = 0; i < processes; i++) {
+            for (auto j = i + 1; j < processes; j++) {
+                int pair[2];
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+                    _impl::fail("socketpair");
+                fds[i * processes + j] = pair[0];
+                fds[j * processes + i] = pair[1];
+            }
+        }
+        fork_group(processes);
+        for (auto i = 0; i < processes * processes; i++) {
+            if (fds[i] >= 0 && i / processes != self)
+                close(fds[i]);
+        }
+        sockets.assign(fds.begin() + self * processes,
+                       fds.begin() + (self + 1) * processes);
+    }
+
+    ~SocketTransport() {
+        for (const auto fd : sockets) {
+            if (fd >= 0)
+                close(fd);
+        }
+    }
+
+    const char * name() const override { return "socket"; }
+
+    void exchange(const std::vector<Message> & out,
+                  const std::vector<Message> & in) override
+    {
+        _impl::deliver_local(self, out, in);
+        _impl::Pending sending{out, self}, receiving{in, self};
+
+        std::vector<pollfd> polls;
+        while (!sending.finished() || !receiving.finished()) {
+            polls.clear();
+            for (auto peer = 0; peer < count; peer++) {
+                short events = 0;
+                if (sending.first(peer) >= 0) events |= POLLOUT;
+                if (receiving.first(peer) >= 0) events |= POLLIN;
+                if (events != 0)
+                    polls.push_back({sockets[peer], events, 0});
+            }
+            if (poll(polls.data(), polls.size(), -1) < 0) {
+                if (errno == EINTR)
+                    continue;
+                _impl::fail("poll");
+            }
+            for (const auto & p : polls) {
+                auto peer = 0;
+                while (sockets[peer] != p.fd)
+                    peer++;
+                const auto o = sending.first(peer);
+                if (o >= 0 && (p.revents & POLLOUT)) {
+                    const auto & m = sending.messages[o];
+                    const auto n = send(p.fd,
+                        static_cast<const char *>(m.data) + sending.done[o],
+                        m.bytes - sending.done[o], MSG_NOSIGNAL | MSG_DONTWAIT);
+                    if (n > 0)
+                        sending.done[o] += n;
+                    else if (n < 0 && errno != EAGAIN && errno != EINTR)
+                        _impl::fail("send");
+                }
+                const auto i = receiving.first(peer);
+                if (i >= 0 && (p.revents & (POLLIN | POLLHUP))) {
+                    const auto & m = receiving.messages[i];
+                    const auto n = recv(p.fd,
+                        static_cast<char *>(m.data) + receiving.done[i],
+                        m.bytes - receiving.done[i], MSG_DONTWAIT);
+                    if (n > 0)
+                        receiving.done[i] += n;
+                    else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+                        _impl::fail("recv");
+                }
+            }
+        }
+    }
+};
+
+// A single producer, single consumer byte ring between every two
+// processes, in memory shared before the fork.
+class ShmTransport : public LocalTransport {
+    static constexpr std::size_t capacity = std::size_t{1} << 18;
+
+    struct Channel {
+        std::atomic<std::uint64_t> head;
+        char pad0[64 - sizeof(std::atomic<std::uint64_t>)];
+        std::atomic<std::uint64_t> tail;
+        char pad1[64 - sizeof(std::atomic<std::uint64_t>)];
+        char data[capacity];
+    };
+
+    Channel * channels = nullptr;
+    std::size_t bytes = 0;
+
+    Channel & channel(const int from, const int to) {
+        return channels[from * count + to];
+    }
+
+    // move as much of n bytes as the ring allows, returning the amount
+    static std::size_t write(Channel & c, const char * data, std::size_t n) {
+        const auto head = c.head.load(std::memory_order_relaxed);
+        const auto tail = c.tail.load(std::memory_order_acquire);
+        n = std::min<std::size_t>(n, capacity - (head - tail));
+        for (std::size_t moved = 0; moved < n; ) {
+            const auto at = (head + moved) % capacity;
+            const auto run = std::min(n - moved, capacity - at);
+            std::memcpy(c.data + at, data + moved, run);
+            moved += run;
+        }
+        c.head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    static std::size_t read(Channel & c, char * data, std::size_t n) {
+        const auto tail = c.tail.load(std::memory_order_relaxed);
+        const auto head = c.head.load(std::memory_order_acquire);
+        n = std::min<std::size_t>(n, head - tail);
+        for (std::size_t moved = 0; moved < n; ) {
+            const auto at = (tail + moved) % capacity;
+            const auto run = std::min(n - moved, capacity - at);
+            std::memcpy(data + moved, c.data + at, run);
+            moved += run;
+        }
+        c.tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+public:
+    ShmTransport(const int processes) {
+        bytes = sizeof(Channel) * processes * processes;
+        const auto memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            _impl::fail("mmap");
+        channels = static_cast<Channel *>(memory);
+        for (auto i = 0; i < processes * processes; i++) {
+            new (&channels[i].head) std::atomic<std::uint64_t>{0};
+            new (&channels[i].tail) std::atomic<std::uint64_t>{0};
+        }
+        assert(channels[0].head.is_lock_free());
+        fork_group(processes);
+    }
+
+    ~ShmTransport() {
+        munmap(channels, bytes);
+    }
+
+    const char * name() const override { return "shm"; }
+
+    void exchange(const std::vector<Message> & out,
+                  const std::vector<Message> & in) override
+    {
+        _impl::deliver_local(self, out, in);
+        _impl::Pending sending{out, self}, receiving{in, self};
+
+        while (!sending.finished() || !receiving.finished()) {
+            std::size_t moved = 0;
+            for (auto peer = 0; peer < count; peer++) {
+                const auto s = sending.first(peer);
+                if (s >= 0) {
+                    const auto & m = sending.messages[s];
+                    const auto n = write(channel(self, peer),
+                        static_cast<const char *>(m.data) + sending.done[s],
+                        m.bytes - sending.done[s]);
+                    sending.done[s] += n;
+                    moved += n;
+                }
+                const auto r = receiving.first(peer);
+                if (r >= 0) {
+                    const auto & m = receiving.messages[r];
+                    const auto n = read(channel(peer, self),
+                        static_cast<char *>(m.data) + receiving.done[r],
+                        m.bytes - receiving.done[r]);
+                    receiving.done[r] += n;
+                    moved += n;
+                }
+            }
+            if (moved == 0)
+                std::this_thread::yield();
+        }
+    }
+};
+
+#ifdef CASE_MPI
+// One process per MPI rank, started by mpirun rather than forked.
+class MPITransport : public Transport {
+    int self = 0;
+    int count = 1;
+    bool owner = false;
+
+public:
+    MPITransport() {
+        int initialized = 0;
+        MPI_Initialized(&initialized);
+        if (initialized == 0) {
+            MPI_Init(nullptr, nullptr);
+            owner = true;
+        }
+        MPI_Comm_rank(MPI_COMM_WORLD, &self);
+        MPI_Comm_size(MPI_COMM_WORLD, &count);
+    }
+
+    ~MPITransport() {
+        if (owner)
+            MPI_Finalize();
+    }
+
+    int rank() const override { return self; }
+    int size() const override { return count; }
+    const char * name() const override { return "mpi"; }
+
+    // MPI keeps messages with the same source and tag in order
+    void exchange(const std::vector<Message> & out,
+                  const std::vector<Message> & in) override
+    {
+        std::vector<MPI_Request> requests(in.size() + out.size());
+        auto request = requests.data();
+        for (const auto & m : in)
+            MPI_Irecv(m.data, static_cast<int>(m.bytes), MPI_BYTE, m.peer, 0,
+                      MPI_COMM_WORLD, request++);
+        for (const auto & m : out)
+            MPI_Isend(m.data, static_cast<int>(m.bytes), MPI_BYTE, m.peer, 0,
+                      MPI_COMM_WORLD, request++);
+        MPI_Waitall(static_cast<int>(requests.size()), requests.data(),
+                    MPI_STATUSES_IGNORE);
+    }
+};
+#endif
+
+// With CASE_MPI the processes are the MPI ranks, otherwise processes are
+// forked here and talk over $CASE_TRANSPORT, "shm" (default) or "socket".
+inline std::unique_ptr<Transport> make_transport(const int processes) {
+#ifdef CASE_MPI
+    (void)processes;
+    return std::unique_ptr<Transport>{new MPITransport};
+#else
+    assert(processes >= 1);
+    const auto env = std::getenv("CASE_TRANSPORT");
+    const std::string kind = env != nullptr ? env : "shm";
+    if (kind == "socket")
+        return std::unique_ptr<Transport>{new SocketTransport{processes}};
+    return std::unique_ptr<Transport>{new ShmTransport{processes}};
+#endif
+}
+
+} // CASE
+
+#endif // CASE_TRANSPORT